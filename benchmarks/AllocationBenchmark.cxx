@@ -0,0 +1,102 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/OpenAddressedHashMap.hxx"
+
+#define RANDOM_SEED 2
+
+// every allocation in the process goes through here, so the counters below
+// include the slot array, per entry values and the pool's slabs alike
+static size_t allocationCount = 0;
+
+static void *countedAllocate(size_t size) {
+  allocationCount++;
+  if (void *p = std::malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+// kept out of line, otherwise free() inlined next to a new expression reads
+// as a mismatched allocation pair
+[[gnu::noinline]] static void countedRelease(void *p) noexcept { std::free(p); }
+
+void *operator new(size_t size) { return countedAllocate(size); }
+void *operator new[](size_t size) { return countedAllocate(size); }
+void operator delete(void *p) noexcept { countedRelease(p); }
+void operator delete(void *p, size_t) noexcept { countedRelease(p); }
+void operator delete[](void *p) noexcept { countedRelease(p); }
+void operator delete[](void *p, size_t) noexcept { countedRelease(p); }
+
+struct LargeValue {
+  std::array<long, 16> data{};
+};
+
+using HeapIntMap = nhzaci::open_addressed_hash_map<int, int>;
+using InlineIntMap = nhzaci::inline_hash_map<int, int>;
+using HeapLargeMap = nhzaci::open_addressed_hash_map<int, LargeValue>;
+using PooledLargeMap = nhzaci::inline_hash_map<int, LargeValue>;
+
+static std::vector<int> generateKeys(size_t n) {
+  std::mt19937 gen(RANDOM_SEED);
+  std::vector<int> keys(n);
+  for (auto &key : keys)
+    key = static_cast<int>(gen());
+  return keys;
+}
+
+// builds a map from scratch every iteration, reporting allocations per entry
+template <typename Map> static void BM_Insert(benchmark::State &state) {
+  auto keys = generateKeys(state.range(0));
+  size_t allocations = 0;
+
+  for (auto _ : state) {
+    auto before = allocationCount;
+    Map m;
+    for (auto key : keys)
+      benchmark::DoNotOptimize(m[key]);
+    allocations += allocationCount - before;
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+  state.counters["allocs_per_entry"] =
+      static_cast<double>(allocations) / (state.iterations() * keys.size());
+}
+
+// looks up keys known to be present and reads their value
+template <typename Map> static void BM_FindHit(benchmark::State &state) {
+  auto keys = generateKeys(state.range(0));
+  Map m;
+  for (auto key : keys)
+    m[key];
+
+  size_t i = 0;
+  for (auto _ : state) {
+    auto &value = m.at(keys[i]);
+    benchmark::DoNotOptimize(value);
+    if (++i == keys.size())
+      i = 0;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+#define WITH_RANGES RangeMultiplier(16)->Range(1 << 10, 1 << 22)
+
+BENCHMARK_TEMPLATE(BM_Insert, std::unordered_map<int, int>)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_Insert, HeapIntMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_Insert, InlineIntMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_Insert, HeapLargeMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_Insert, PooledLargeMap)->WITH_RANGES;
+
+BENCHMARK_TEMPLATE(BM_FindHit, std::unordered_map<int, int>)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_FindHit, HeapIntMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_FindHit, InlineIntMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_FindHit, HeapLargeMap)->WITH_RANGES;
+BENCHMARK_TEMPLATE(BM_FindHit, PooledLargeMap)->WITH_RANGES;
+
+BENCHMARK_MAIN();
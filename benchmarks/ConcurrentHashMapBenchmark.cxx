@@ -0,0 +1,109 @@
+#include <benchmark/benchmark.h>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/ConcurrentHashMap.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+#define RANDOM_SEED 2
+
+static constexpr size_t kKeys = 1 << 16;
+static constexpr size_t kLookupsPerIteration = 1024;
+
+// wraps a single threaded map behind one mutex, the setup the concurrent map
+// is meant to replace
+template <typename Map> class MutexWrappedMap {
+public:
+  bool contains(int key) const {
+    std::lock_guard lock(mutex_);
+    return map_.find(key) != map_.end();
+  }
+
+  void insert_or_assign(int key, int value) {
+    std::lock_guard lock(mutex_);
+    map_[key] = value;
+  }
+
+private:
+  mutable std::mutex mutex_;
+  Map map_;
+};
+
+using MutexOpenAddressedMap =
+    MutexWrappedMap<nhzaci::open_addressed_hash_map<int, int>>;
+using MutexUnorderedMap = MutexWrappedMap<std::unordered_map<int, int>>;
+using ConcurrentMap = nhzaci::concurrent_hash_map<int, int>;
+
+static const std::vector<int> &keys() {
+  static const std::vector<int> generated = [] {
+    std::mt19937 gen(RANDOM_SEED);
+    std::vector<int> keys(kKeys);
+    for (auto &key : keys)
+      key = static_cast<int>(gen());
+    return keys;
+  }();
+  return generated;
+}
+
+// shared by every thread of a benchmark, built before any thread starts
+template <typename Map> static Map &sharedMap() {
+  static Map map;
+  [[maybe_unused]] static bool filled = [] {
+    for (auto key : keys())
+      map.insert_or_assign(key, key);
+    return true;
+  }();
+  return map;
+}
+
+// every thread looks up its own stride of the pre-generated keys
+template <typename Map> static void BM_Read(benchmark::State &state) {
+  auto &map = sharedMap<Map>();
+  auto &ks = keys();
+  size_t i = state.thread_index() * (kKeys / state.threads());
+
+  for (auto _ : state) {
+    for (size_t n = 0; n < kLookupsPerIteration; n++) {
+      benchmark::DoNotOptimize(map.contains(ks[i]));
+      i = (i + 1) & (kKeys - 1);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kLookupsPerIteration);
+}
+
+// thread 0 keeps updating existing keys while every other thread reads,
+// items processed only counts the readers
+template <typename Map> static void BM_ReadWithWriter(benchmark::State &state) {
+  auto &map = sharedMap<Map>();
+  auto &ks = keys();
+  size_t i = state.thread_index() * (kKeys / state.threads());
+  bool writer = state.thread_index() == 0 and state.threads() > 1;
+
+  for (auto _ : state) {
+    for (size_t n = 0; n < kLookupsPerIteration; n++) {
+      if (writer)
+        map.insert_or_assign(ks[i], static_cast<int>(n));
+      else
+        benchmark::DoNotOptimize(map.contains(ks[i]));
+      i = (i + 1) & (kKeys - 1);
+    }
+  }
+
+  if (not writer)
+    state.SetItemsProcessed(state.iterations() * kLookupsPerIteration);
+}
+
+#define WITH_THREADS ThreadRange(1, 16)->UseRealTime()
+
+BENCHMARK_TEMPLATE(BM_Read, ConcurrentMap)->WITH_THREADS;
+BENCHMARK_TEMPLATE(BM_Read, MutexOpenAddressedMap)->WITH_THREADS;
+BENCHMARK_TEMPLATE(BM_Read, MutexUnorderedMap)->WITH_THREADS;
+
+BENCHMARK_TEMPLATE(BM_ReadWithWriter, ConcurrentMap)->WITH_THREADS;
+BENCHMARK_TEMPLATE(BM_ReadWithWriter, MutexOpenAddressedMap)->WITH_THREADS;
+BENCHMARK_TEMPLATE(BM_ReadWithWriter, MutexUnorderedMap)->WITH_THREADS;
+
+BENCHMARK_MAIN();
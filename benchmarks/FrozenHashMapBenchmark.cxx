@@ -0,0 +1,170 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/FrozenHashMap.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+#define RANDOM_SEED 2
+
+static constexpr size_t kLookups = 1 << 16;
+
+using OpenAddressedMap = nhzaci::open_addressed_hash_map<uint64_t, uint64_t>;
+using InlineMap = nhzaci::inline_hash_map<uint64_t, uint64_t>;
+using UnorderedMap = std::unordered_map<uint64_t, uint64_t>;
+using FrozenMap = nhzaci::frozen_hash_map<uint64_t, uint64_t>;
+
+// random 64-bit keys, the same for every map of a given size
+static std::vector<uint64_t> makeKeys(size_t items) {
+  std::mt19937_64 gen(RANDOM_SEED);
+  std::vector<uint64_t> keys(items);
+  for (auto &key : keys)
+    key = gen();
+  return keys;
+}
+
+// hits drawn uniformly over keys, generated outside timing
+static std::vector<uint64_t> makeLookups(const std::vector<uint64_t> &keys) {
+  std::mt19937 gen(RANDOM_SEED);
+  std::uniform_int_distribution<size_t> dist(0, keys.size() - 1);
+  std::vector<uint64_t> lookups(kLookups);
+  for (auto &key : lookups)
+    key = keys[dist(gen)];
+  return lookups;
+}
+
+template <typename Map> static Map makeMap(const std::vector<uint64_t> &keys) {
+  Map map;
+  for (auto key : keys)
+    map[key] = key;
+  return map;
+}
+
+template <> FrozenMap makeMap<FrozenMap>(const std::vector<uint64_t> &keys) {
+  return FrozenMap(makeMap<OpenAddressedMap>(keys));
+}
+
+template <typename Map> static void BM_FindHit(benchmark::State &st) {
+  auto keys = makeKeys(st.range(0));
+  auto lookups = makeLookups(keys);
+  auto map = makeMap<Map>(keys);
+  size_t i = 0;
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(map.find(lookups[i])->second);
+    i = (i + 1) & (kLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations());
+}
+
+// node layouts name the mapped value differently, so hits go through at()
+template <typename Map> static void BM_AtHit(benchmark::State &st) {
+  auto keys = makeKeys(st.range(0));
+  auto lookups = makeLookups(keys);
+  auto map = makeMap<Map>(keys);
+  size_t i = 0;
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(map.at(lookups[i]));
+    i = (i + 1) & (kLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations());
+}
+
+// misses are random keys, almost surely not in the map
+template <typename Map> static void BM_ContainsMiss(benchmark::State &st) {
+  auto map = makeMap<Map>(makeKeys(st.range(0)));
+  auto misses = makeKeys(kLookups + st.range(0));
+  size_t i = 0;
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(map.contains(misses[st.range(0) + i]));
+    i = (i + 1) & (kLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations());
+}
+
+// one off cost of freezing an open_addressed_hash_map
+static void BM_FreezeMap(benchmark::State &st) {
+  auto map = makeMap<OpenAddressedMap>(makeKeys(st.range(0)));
+
+  for (auto _ : st) {
+    FrozenMap frozen(map);
+    benchmark::DoNotOptimize(frozen.size());
+  }
+
+  st.SetItemsProcessed(st.iterations() * st.range(0));
+}
+
+#define WITH_SIZES Arg(64)->Arg(4096)->Arg(1 << 20)
+
+BENCHMARK_TEMPLATE(BM_FindHit, UnorderedMap)->WITH_SIZES;
+BENCHMARK_TEMPLATE(BM_AtHit, OpenAddressedMap)->WITH_SIZES;
+BENCHMARK_TEMPLATE(BM_AtHit, InlineMap)->WITH_SIZES;
+BENCHMARK_TEMPLATE(BM_AtHit, FrozenMap)->WITH_SIZES;
+
+BENCHMARK_TEMPLATE(BM_ContainsMiss, OpenAddressedMap)->WITH_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsMiss, InlineMap)->WITH_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsMiss, FrozenMap)->WITH_SIZES;
+
+BENCHMARK(BM_FreezeMap)->WITH_SIZES;
+
+// exchange code table built at compile time, against the same codes in an
+// open_addressed_hash_map
+static constexpr auto kExchangeCodes =
+    nhzaci::make_frozen_hash_map<std::string_view, int>({
+        {"XNYS", 0},  {"XNAS", 1},  {"XASE", 2},  {"ARCX", 3},  {"BATS", 4},
+        {"BATY", 5},  {"EDGA", 6},  {"EDGX", 7},  {"IEXG", 8},  {"MEMX", 9},
+        {"XCHI", 10}, {"XBOS", 11}, {"XPHL", 12}, {"XLON", 13}, {"XPAR", 14},
+        {"XAMS", 15}, {"XBRU", 16}, {"XETR", 17}, {"XSWX", 18}, {"XMIL", 19},
+        {"XMAD", 20}, {"XTKS", 21}, {"XHKG", 22}, {"XASX", 23}, {"XSES", 24},
+        {"XKRX", 25}, {"XTSE", 26}, {"XBOM", 27}, {"XNSE", 28}, {"XSHG", 29},
+        {"XSHE", 30}, {"XJSE", 31},
+    });
+
+static std::vector<std::string_view> exchangeLookups() {
+  std::mt19937 gen(RANDOM_SEED);
+  std::uniform_int_distribution<size_t> dist(0, kExchangeCodes.size() - 1);
+  std::vector<std::string_view> lookups(kLookups);
+  for (auto &code : lookups)
+    code = kExchangeCodes.begin()[dist(gen)].key;
+  return lookups;
+}
+
+static void BM_ExchangeCodeOpenAddressed(benchmark::State &st) {
+  nhzaci::open_addressed_hash_map<std::string_view, int> map;
+  for (auto &node : kExchangeCodes)
+    map[node.key] = node.value();
+  auto lookups = exchangeLookups();
+  size_t i = 0;
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(map.at(lookups[i]));
+    i = (i + 1) & (kLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations());
+}
+
+static void BM_ExchangeCodeFrozen(benchmark::State &st) {
+  auto lookups = exchangeLookups();
+  size_t i = 0;
+
+  for (auto _ : st) {
+    benchmark::DoNotOptimize(kExchangeCodes.at(lookups[i]));
+    i = (i + 1) & (kLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations());
+}
+
+BENCHMARK(BM_ExchangeCodeOpenAddressed);
+BENCHMARK(BM_ExchangeCodeFrozen);
+
+BENCHMARK_MAIN();
@@ -1,23 +1,37 @@
 #include <benchmark/benchmark.h>
 #include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <random>
+#include <string>
+#include <vector>
 
 #include <unordered_map>
 
+#include "../src/MappedHashMap.hxx"
 #include "../src/OpenAddressedHashMap.hxx"
 
 #define RANDOM_SEED 2
 
+static constexpr size_t kLookupKeys = 1 << 16;
+
 template <typename Map>
 class HashMapBenchmarkFixture : public benchmark::Fixture {
 public:
   Map m;
+  // lookup keys drawn up front, as pausing the timer around every lookup
+  // costs far more than the lookup itself
+  std::vector<int> keys;
 
   void SetUp(const ::benchmark::State &state) {
     std::srand(RANDOM_SEED);
     for (size_t i = 0; i < state.range(0); i++) {
       m[std::rand()] = std::rand();
     }
+
+    keys.resize(kLookupKeys);
+    for (auto &key : keys)
+      key = std::rand();
   }
 
   void TearDown(const ::benchmark::State &state) {}
@@ -25,13 +39,12 @@ public:
 
 #define FIND_ITEM_FROM_MAP                                                     \
   (benchmark::State & st) {                                                    \
+    size_t i = 0;                                                              \
     for (auto _ : st) {                                                        \
-      st.PauseTiming();                                                        \
-      auto key = std::rand();                                                  \
-      st.ResumeTiming();                                                       \
-      auto itr = m.find(key);                                                  \
+      auto itr = m.find(keys[i]);                                              \
       benchmark::DoNotOptimize(itr);                                           \
       benchmark::ClobberMemory();                                              \
+      i = (i + 1) & (kLookupKeys - 1);                                         \
     }                                                                          \
   }
 
@@ -50,4 +63,121 @@ BENCHMARK_REGISTER_F(HashMapBenchmarkFixture, stdUnorderedMapFindTest)
 BENCHMARK_REGISTER_F(HashMapBenchmarkFixture, openAddressedMapFindTest)
     ->WITH_RANGES;
 
+// 2^23 keys spread over 2^24 buckets plus one heap value each, several times
+// the size of a typical last level cache so that nearly every probe misses
+static constexpr size_t kBatchTableKeys = 1 << 23;
+static constexpr size_t kBatchLookups = 1 << 16;
+
+using BatchMap = nhzaci::open_addressed_hash_map<int, int>;
+
+static const BatchMap &batchMap() {
+  static BatchMap map;
+  [[maybe_unused]] static bool filled = [] {
+    map.reserve(kBatchTableKeys);
+    for (size_t i = 0; i < kBatchTableKeys; i++)
+      map[static_cast<int>(i)] = static_cast<int>(i);
+    return true;
+  }();
+  return map;
+}
+
+// hits drawn uniformly over the whole table, generated outside timing
+static const std::vector<int> &batchKeys() {
+  static const std::vector<int> keys = [] {
+    std::mt19937 gen(RANDOM_SEED);
+    std::uniform_int_distribution<int> dist(0, kBatchTableKeys - 1);
+    std::vector<int> keys(kBatchLookups);
+    for (auto &key : keys)
+      key = dist(gen);
+    return keys;
+  }();
+  return keys;
+}
+
+static void BM_FindScalarLoop(benchmark::State &st) {
+  auto &m = batchMap();
+  auto &keys = batchKeys();
+  size_t batch = st.range(0);
+  size_t offset = 0;
+
+  for (auto _ : st) {
+    long sum = 0;
+    for (size_t i = 0; i < batch; i++)
+      sum += m.at(keys[offset + i]);
+    benchmark::DoNotOptimize(sum);
+    offset = (offset + batch) & (kBatchLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations() * batch);
+}
+
+static void BM_FindBatch(benchmark::State &st) {
+  auto &m = batchMap();
+  auto &keys = batchKeys();
+  size_t batch = st.range(0);
+  size_t offset = 0;
+  std::vector<const int *> values(batch);
+
+  for (auto _ : st) {
+    m.find_batch(std::span(keys).subspan(offset, batch), values);
+    long sum = 0;
+    for (auto v : values)
+      sum += *v;
+    benchmark::DoNotOptimize(sum);
+    offset = (offset + batch) & (kBatchLookups - 1);
+  }
+
+  st.SetItemsProcessed(st.iterations() * batch);
+}
+
+#define WITH_BATCH_SIZES Arg(1)->Arg(8)->Arg(32)->Arg(128)
+
+BENCHMARK(BM_FindScalarLoop)->WITH_BATCH_SIZES;
+BENCHMARK(BM_FindBatch)->WITH_BATCH_SIZES;
+
+// time until a map of st.range(0) items can serve lookups, rebuilding it by
+// inserting every item versus mapping a snapshot of it
+static std::string warmStartSnapshot(size_t items) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("nhzaci_warm_start_" + std::to_string(items) + ".snap"))
+                  .string();
+  nhzaci::open_addressed_hash_map<long, long> map;
+  for (size_t i = 0; i < items; i++)
+    map[static_cast<long>(i)] = static_cast<long>(i);
+  nhzaci::save(map, path);
+  return path;
+}
+
+static void BM_WarmStartByInsert(benchmark::State &st) {
+  size_t items = st.range(0);
+
+  for (auto _ : st) {
+    nhzaci::open_addressed_hash_map<long, long> map;
+    for (size_t i = 0; i < items; i++)
+      map[static_cast<long>(i)] = static_cast<long>(i);
+    benchmark::DoNotOptimize(map.at(0));
+  }
+
+  st.SetItemsProcessed(st.iterations() * items);
+}
+
+static void BM_WarmStartFromSnapshot(benchmark::State &st) {
+  size_t items = st.range(0);
+  bool verify = st.range(1);
+  auto path = warmStartSnapshot(items);
+
+  for (auto _ : st) {
+    nhzaci::mapped_hash_map<long, long> map(
+        path, nhzaci::snapshot_access::read_only, verify);
+    benchmark::DoNotOptimize(map.at(0));
+  }
+
+  std::filesystem::remove(path);
+  st.SetItemsProcessed(st.iterations() * items);
+}
+
+BENCHMARK(BM_WarmStartByInsert)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_WarmStartFromSnapshot)
+    ->ArgsProduct({benchmark::CreateRange(1 << 10, 1 << 22, 8), {0, 1}});
+
 BENCHMARK_MAIN();
\ No newline at end of file
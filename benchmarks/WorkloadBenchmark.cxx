@@ -0,0 +1,470 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../src/GroupProbe.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+#include "../src/RobinHoodProbe.hxx"
+
+// Workload matrix over map types, key types, key distributions and max load
+// factors. Every operation is timed on its own, reporting p50/p99/p99.9
+// latency next to the mean, and inserts report heap bytes per entry. Keys are
+// generated before timing starts, and work needed to keep a workload going
+// (refilling after erase, starting over once a table is full) happens
+// outside of the timed operations instead of pausing the timer.
+//
+// Filter with e.g. --benchmark_filter='Lookup/hit/.*/uint64/zipf'
+
+#define RANDOM_SEED 2
+
+// distinct keys in every table
+static constexpr size_t kEntries = 1 << 18;
+// operations timed per benchmark, also the length of every key stream
+static constexpr size_t kOps = 1 << 20;
+static constexpr size_t kTraversals = 64;
+static constexpr double kZipfExponent = 0.99;
+
+////////////////////////////
+// Heap accounting        //
+////////////////////////////
+
+// live and peak heap bytes of the process, single threaded
+static size_t heapLive = 0;
+static size_t heapPeak = 0;
+
+void *operator new(size_t size) {
+  if (void *p = std::malloc(size)) {
+    heapLive += malloc_usable_size(p);
+    heapPeak = std::max(heapPeak, heapLive);
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+  heapLive -= malloc_usable_size(p);
+  std::free(p);
+}
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+static double peakRssMb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+////////////////////////////
+// Per operation timing   //
+////////////////////////////
+
+// cycle counter fenced so that the timed operation cannot leak out of the
+// measured window, steady_clock elsewhere
+struct tick_clock {
+#if defined(__x86_64__) || defined(__i386__)
+  static uint64_t start() noexcept {
+    _mm_lfence();
+    return __rdtsc();
+  }
+  static uint64_t stop() noexcept {
+    unsigned aux;
+    auto t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+  }
+#else
+  static uint64_t start() noexcept { return now(); }
+  static uint64_t stop() noexcept { return now(); }
+  static uint64_t now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+#endif
+
+  static double ns_per_tick() {
+    static const double calibrated = [] {
+      auto wall = std::chrono::steady_clock::now();
+      auto ticks = start();
+      while (std::chrono::steady_clock::now() - wall <
+             std::chrono::milliseconds(20))
+        ;
+      auto elapsed = std::chrono::duration<double, std::nano>(
+          std::chrono::steady_clock::now() - wall);
+      return elapsed.count() / (stop() - ticks);
+    }();
+    return calibrated;
+  }
+
+  // cost of an empty start/stop pair, taken off every sample
+  static uint64_t overhead() {
+    static const uint64_t measured = [] {
+      uint64_t least = ~0ull;
+      for (int i = 0; i < 10000; i++) {
+        auto t = start();
+        least = std::min(least, stop() - t);
+      }
+      return least;
+    }();
+    return measured;
+  }
+};
+
+/**
+ * @brief Collects the latency of every timed operation of a benchmark,
+ *        feeding the sum to the benchmark as manual time
+ */
+class latency_recorder {
+public:
+  explicit latency_recorder(benchmark::State &state) : state_{state} {
+    samples_.reserve(state.max_iterations);
+  }
+
+  void start() noexcept { start_ = tick_clock::start(); }
+  void stop() {
+    auto ticks = tick_clock::stop() - start_;
+    auto overhead = tick_clock::overhead();
+    auto ns = (ticks > overhead ? ticks - overhead : 0) *
+              tick_clock::ns_per_tick();
+    samples_.push_back(ns);
+    state_.SetIterationTime(ns * 1e-9);
+  }
+
+  // items_per_op scales throughput for operations covering many entries
+  void report(size_t items_per_op = 1) {
+    state_.SetItemsProcessed(state_.iterations() * items_per_op);
+    if (samples_.empty())
+      return;
+
+    std::sort(samples_.begin(), samples_.end());
+    state_.counters["p50_ns"] = percentile(0.5);
+    state_.counters["p99_ns"] = percentile(0.99);
+    state_.counters["p99.9_ns"] = percentile(0.999);
+  }
+
+private:
+  benchmark::State &state_;
+  std::vector<double> samples_;
+  uint64_t start_ = 0;
+
+  double percentile(double p) const {
+    auto rank = static_cast<size_t>(std::ceil(p * samples_.size()));
+    return samples_[std::clamp<size_t>(rank, 1, samples_.size()) - 1];
+  }
+};
+
+////////////////////////////
+// Workloads              //
+////////////////////////////
+
+enum class key_dist { sequential, zipf };
+
+static uint64_t makeKey(uint64_t i, uint64_t) { return i; }
+// long enough to live on the heap rather than in the small string buffer
+static std::string makeKey(uint64_t i, std::string) {
+  return "instrument/" + std::to_string(i);
+}
+
+// draws ranks 0..n-1, rank r with probability proportional to 1/(r+1)^s
+class zipf_distribution {
+public:
+  zipf_distribution(size_t n, double s) : cdf_(n) {
+    double sum = 0;
+    for (size_t r = 0; r < n; r++)
+      cdf_[r] = sum += 1.0 / std::pow(r + 1, s);
+    for (auto &c : cdf_)
+      c /= sum;
+  }
+
+  template <typename Gen> size_t operator()(Gen &gen) const {
+    auto u = std::uniform_real_distribution<double>(0, 1)(gen);
+    auto r = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    return std::min<size_t>(r, cdf_.size() - 1);
+  }
+
+private:
+  std::vector<double> cdf_;
+};
+
+/**
+ * @brief Keys of a table and the streams operations walk through. Zipf
+ *        streams hit a few hot keys most of the time, with ranks shuffled so
+ *        that hot keys are not neighbours in the key set.
+ */
+template <typename Key> struct workload {
+  std::vector<Key> keys;   // inserted keys, distinct
+  std::vector<Key> hits;   // stream over keys
+  std::vector<Key> misses; // stream over keys never inserted
+  std::vector<Key> mixed;  // hits and misses interleaved half and half
+
+  workload(key_dist dist) {
+    std::mt19937_64 gen(RANDOM_SEED);
+    std::vector<uint64_t> order(kEntries);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), gen);
+    zipf_distribution zipf(kEntries, kZipfExponent);
+
+    for (uint64_t i = 0; i < kEntries; i++)
+      keys.push_back(makeKey(i, Key{}));
+
+    for (size_t i = 0; i < kOps; i++) {
+      auto id = dist == key_dist::sequential ? i % kEntries : order[zipf(gen)];
+      hits.push_back(keys[id]);
+      misses.push_back(makeKey(id + kEntries, Key{}));
+      mixed.push_back(gen() & 1 ? hits.back() : misses.back());
+    }
+  }
+
+  static const workload &get(key_dist dist) {
+    static const workload sequential(key_dist::sequential);
+    static const workload zipf(key_dist::zipf);
+    return dist == key_dist::sequential ? sequential : zipf;
+  }
+};
+
+template <typename Map> static void configure(Map &m, float max_load_factor) {
+  m.max_load_factor(max_load_factor);
+}
+
+template <typename Map, typename Key>
+static void fill(Map &m, const workload<Key> &w) {
+  uint64_t v = 0;
+  for (auto &key : w.keys)
+    m[key] = v++;
+}
+
+// std::unordered_map iterates over pairs, open_addressed_hash_map over nodes
+template <typename Entry> static const uint64_t &valueOf(const Entry &e) {
+  if constexpr (requires { e.second; })
+    return e.second;
+  else
+    return e.value();
+}
+
+////////////////////////////
+// Benchmarks             //
+////////////////////////////
+
+// inserts the key stream into a fresh table, starting over with a new table
+// whenever the stream runs out, optionally reserved up front
+template <typename Map, typename Key>
+static void BM_Insert(benchmark::State &state, key_dist dist, float lf,
+                      bool reserved) {
+  auto &w = workload<Key>::get(dist);
+  auto &stream = dist == key_dist::sequential ? w.keys : w.hits;
+  latency_recorder recorder(state);
+
+  size_t i = 0;
+  double bytesPerEntry = 0;
+  double peakBytesPerEntry = 0;
+  auto m = std::make_unique<Map>();
+
+  auto start_table = [&] {
+    m = std::make_unique<Map>();
+    configure(*m, lf);
+    if (reserved)
+      m->reserve(kEntries);
+  };
+  auto base = heapLive;
+  start_table();
+  heapPeak = heapLive;
+
+  for (auto _ : state) {
+    recorder.start();
+    (*m)[stream[i]] = i;
+    recorder.stop();
+
+    if (++i == stream.size()) {
+      bytesPerEntry = static_cast<double>(heapLive - base) / m->size();
+      peakBytesPerEntry = static_cast<double>(heapPeak - base) / m->size();
+      m.reset();
+      base = heapLive;
+      start_table();
+      heapPeak = heapLive;
+      i = 0;
+    }
+  }
+
+  if (bytesPerEntry == 0 and not m->empty()) {
+    bytesPerEntry = static_cast<double>(heapLive - base) / m->size();
+    peakBytesPerEntry = static_cast<double>(heapPeak - base) / m->size();
+  }
+
+  recorder.report();
+  state.counters["bytes_per_entry"] = bytesPerEntry;
+  state.counters["peak_bytes_per_entry"] = peakBytesPerEntry;
+  state.counters["peak_rss_mb"] = peakRssMb();
+}
+
+enum class lookup { hit, miss, mixed };
+
+template <typename Map, typename Key>
+static void BM_Lookup(benchmark::State &state, key_dist dist, float lf,
+                      lookup kind) {
+  auto &w = workload<Key>::get(dist);
+  auto &stream = kind == lookup::hit    ? w.hits
+                 : kind == lookup::miss ? w.misses
+                                        : w.mixed;
+  Map m;
+  configure(m, lf);
+  fill(m, w);
+  latency_recorder recorder(state);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    recorder.start();
+    auto itr = m.find(stream[i]);
+    benchmark::DoNotOptimize(itr != m.end());
+    recorder.stop();
+    i = (i + 1) & (kOps - 1);
+  }
+
+  recorder.report();
+}
+
+// read-modify-write of values already in the table
+template <typename Map, typename Key>
+static void BM_Subscript(benchmark::State &state, key_dist dist, float lf) {
+  auto &w = workload<Key>::get(dist);
+  Map m;
+  configure(m, lf);
+  fill(m, w);
+  latency_recorder recorder(state);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    recorder.start();
+    m[w.hits[i]]++;
+    recorder.stop();
+    i = (i + 1) & (kOps - 1);
+  }
+
+  recorder.report();
+}
+
+// erases a key and puts it back untimed, so the table stays full
+template <typename Map, typename Key>
+static void BM_Erase(benchmark::State &state, key_dist dist, float lf) {
+  auto &w = workload<Key>::get(dist);
+  Map m;
+  configure(m, lf);
+  fill(m, w);
+  latency_recorder recorder(state);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    recorder.start();
+    benchmark::DoNotOptimize(m.erase(w.hits[i]));
+    recorder.stop();
+    m[w.hits[i]] = i;
+    i = (i + 1) & (kOps - 1);
+  }
+
+  recorder.report();
+}
+
+// one operation is a whole traversal, reported per entry visited
+template <typename Map, typename Key>
+static void BM_Iterate(benchmark::State &state, key_dist dist, float lf) {
+  auto &w = workload<Key>::get(dist);
+  Map m;
+  configure(m, lf);
+  fill(m, w);
+  latency_recorder recorder(state);
+
+  for (auto _ : state) {
+    recorder.start();
+    uint64_t sum = 0;
+    for (auto &entry : m)
+      sum += valueOf(entry);
+    benchmark::DoNotOptimize(sum);
+    recorder.stop();
+  }
+
+  recorder.report(m.size());
+}
+
+////////////////////////////
+// Registration           //
+////////////////////////////
+
+template <typename Key>
+using group_map = nhzaci::open_addressed_hash_map<
+    Key, uint64_t, std::hash<Key>, std::equal_to<Key>,
+    std::allocator<nhzaci::select_map_node<Key, uint64_t>>,
+    nhzaci::group_probe<Key, nhzaci::select_map_node<Key, uint64_t>,
+                        std::hash<Key>, std::equal_to<Key>>>;
+
+template <typename Key>
+using robin_hood_map = nhzaci::open_addressed_hash_map<
+    Key, uint64_t, std::hash<Key>, std::equal_to<Key>,
+    std::allocator<nhzaci::select_map_node<Key, uint64_t>>,
+    nhzaci::robin_hood_probe<Key, nhzaci::select_map_node<Key, uint64_t>,
+                             std::hash<Key>, std::equal_to<Key>,
+                             nhzaci::fibonacci_index>>;
+
+static constexpr float kLoadFactors[] = {0.5, 0.7, 0.9};
+
+template <typename Map, typename Key>
+static void registerMap(const std::string &mapName,
+                        const std::string &keyName) {
+  for (auto dist : {key_dist::sequential, key_dist::zipf}) {
+    for (auto lf : kLoadFactors) {
+      auto suffix = "/" + mapName + "/" + keyName + "/" +
+                    (dist == key_dist::sequential ? "seq" : "zipf") +
+                    "/lf:" + std::to_string(lf).substr(0, 3);
+      auto add = [&](const std::string &name, auto fn, size_t iterations,
+                     auto... args) {
+        benchmark::RegisterBenchmark((name + suffix).c_str(), fn, dist, lf,
+                                     args...)
+            ->Iterations(iterations)
+            ->UseManualTime();
+      };
+
+      add("Insert/growth", BM_Insert<Map, Key>, kOps, false);
+      add("Insert/reserved", BM_Insert<Map, Key>, kOps, true);
+      add("Lookup/hit", BM_Lookup<Map, Key>, kOps, lookup::hit);
+      add("Lookup/miss", BM_Lookup<Map, Key>, kOps, lookup::miss);
+      add("Lookup/mixed", BM_Lookup<Map, Key>, kOps, lookup::mixed);
+      add("Subscript", BM_Subscript<Map, Key>, kOps);
+      add("Erase", BM_Erase<Map, Key>, kOps);
+      add("Iterate", BM_Iterate<Map, Key>, kTraversals);
+    }
+  }
+}
+
+template <typename Key> static void registerKey(const std::string &keyName) {
+  registerMap<std::unordered_map<Key, uint64_t>, Key>("std::unordered_map",
+                                                      keyName);
+  registerMap<nhzaci::open_addressed_hash_map<Key, uint64_t>, Key>(
+      "open_addressed_hash_map", keyName);
+  registerMap<nhzaci::inline_hash_map<Key, uint64_t>, Key>("inline_hash_map",
+                                                           keyName);
+  registerMap<group_map<Key>, Key>("group_probe", keyName);
+  registerMap<robin_hood_map<Key>, Key>("robin_hood_probe", keyName);
+}
+
+int main(int argc, char **argv) {
+  registerKey<uint64_t>("uint64");
+  registerKey<std::string>("string");
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include "EpochReclamation.hxx"
+#include "MapNode.hxx"
+#include "Probe.hxx"
+
+namespace nhzaci {
+
+/**
+ * @brief Read mostly hash map whose readers never take a lock, laid out as a
+ *        linearly probed array of MapNode like open_addressed_hash_map.
+ *
+ *        Writers are serialised by a mutex, so the usual setup is a single
+ *        writer thread, while any number of threads look keys up concurrently.
+ *        A published value is immutable, writers swap in a new value by
+ *        atomically replacing the bucket's pointer, and erasing leaves a
+ *        tombstone pointer behind so that the key stays put for readers. A
+ *        bucket is only ever reused for the key it already holds, growing or
+ *        purging tombstones builds a new table and publishes it atomically.
+ *
+ *        Replaced values and old tables are retired to epoch based
+ *        reclamation, and freed once every reader that could still see them
+ *        has finished its lookup. Readers therefore only get copies or scoped
+ *        access through visit(), never references that outlive a lookup.
+ *
+ * @tparam Key        Type of key objects, must not change after insertion
+ * @tparam T          Type of mapped objects, must be copy constructible
+ * @tparam Hash       Hashing function object type, defaults to std::hash<Key>
+ * @tparam KeyEqual   Predicate function object type, defaults to
+ * std::equal_to<Key>
+ * @tparam Index      Maps a hash onto its home bucket, defaults to mask_index
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>, typename Index = mask_index>
+class concurrent_hash_map {
+  // values are retired through the epoch domain rather than freed by nodes
+  struct retired_value_deleter {
+    void operator()(T *) const noexcept {}
+  };
+
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = MapNode<Key, T, retired_value_deleter>;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using prober = probe<Key, value_type, Hash, KeyEqual, Index>;
+
+  concurrent_hash_map()
+      : table_{new table(kInitialBuckets)}, max_load_factor_{0.75} {}
+  ~concurrent_hash_map() {
+    // no reader may be left, so the current table goes straight away
+    auto tbl = table_.load();
+    for (size_type i = 0; i < tbl->max_size; i++)
+      delete_value(tbl->container[i].t_p);
+    delete tbl;
+  }
+
+  concurrent_hash_map(const concurrent_hash_map &) = delete;
+  concurrent_hash_map &operator=(const concurrent_hash_map &) = delete;
+
+  /////////////////////
+  // Capacity start  //
+  /////////////////////
+
+  bool empty() const noexcept { return size() == 0; }
+  size_type size() const noexcept {
+    return curr_size_.load(std::memory_order_relaxed);
+  }
+
+  /////////////////////
+  // Capacity end    //
+  /////////////////////
+
+  /////////////////////
+  // Modifiers start //
+  /////////////////////
+
+  /**
+   * @brief Swaps in an empty table, readers still in a lookup carry on over
+   *        the old table, whose values are freed along with it
+   */
+  void clear() {
+    std::lock_guard lock(writer_mutex_);
+    // values stay reachable through the old table until it is unpublished,
+    // so they may only be retired together with it
+    auto oldTable = table_.exchange(new table(kInitialBuckets));
+    retired_.retire(oldTable, [](void *p) {
+      auto tbl = static_cast<table *>(p);
+      for (size_type i = 0; i < tbl->max_size; i++)
+        delete_value(tbl->container[i].t_p);
+      delete tbl;
+    });
+    retired_.reclaim();
+    curr_size_.store(0, std::memory_order_relaxed);
+    tombstones_ = 0;
+  }
+
+  /**
+   * @brief Inserts value under key if key is not in the hash map yet
+   *
+   * @return bool   true if value was inserted
+   */
+  bool insert(const key_type &key, const mapped_type &value) {
+    std::lock_guard lock(writer_mutex_);
+    auto &node = claim_bucket(key);
+    if (is_live(node.t_p))
+      return false;
+
+    publish_value(node, key, new T(value));
+    return true;
+  }
+
+  /**
+   * @brief Inserts value under key, or replaces the value key maps to. Readers
+   *        see either the old or the new value, never a mix of both.
+   *
+   * @return bool   true if value was inserted, false if it was assigned
+   */
+  bool insert_or_assign(const key_type &key, const mapped_type &value) {
+    std::lock_guard lock(writer_mutex_);
+    auto &node = claim_bucket(key);
+    auto old = node.t_p;
+
+    publish_value(node, key, new T(value));
+    if (not is_live(old))
+      return true;
+
+    retire_value(old);
+    return false;
+  }
+
+  size_type erase(const key_type &key) {
+    std::lock_guard lock(writer_mutex_);
+    auto tbl = table_.load();
+    auto bucket = probe_fn_.find_item_key(tbl->container.get(), tbl->max_size,
+                                          key, hash_fn_, key_equal_fn_);
+    if (bucket == tbl->max_size)
+      return 0;
+
+    auto &node = tbl->container[bucket];
+    auto old = node.t_p;
+    if (old == tombstone())
+      return 0;
+
+    // the key stays behind so that probes for keys past it keep going
+    std::atomic_ref<T *>(node.t_p).store(tombstone());
+    retire_value(old);
+    curr_size_.fetch_sub(1, std::memory_order_relaxed);
+    tombstones_++;
+    return 1;
+  }
+
+  /////////////////////
+  // Modifiers end   //
+  /////////////////////
+
+  /////////////////////
+  // Lookup start    //
+  /////////////////////
+
+  /**
+   * @brief Calls f with a const reference to the value key maps to, the
+   *        reference must not escape f as the value may be freed afterwards
+   *
+   * @return bool   true if key was found and f was called
+   */
+  template <typename F> bool visit(const key_type &key, F &&f) const {
+    epoch_guard guard;
+    auto t_p = find_value(key);
+    if (t_p == nullptr)
+      return false;
+
+    std::forward<F>(f)(std::as_const(*t_p));
+    return true;
+  }
+
+  std::optional<T> find(const key_type &key) const {
+    epoch_guard guard;
+    auto t_p = find_value(key);
+    if (t_p == nullptr)
+      return std::nullopt;
+    return *t_p;
+  }
+
+  T at(const key_type &key) const {
+    epoch_guard guard;
+    auto t_p = find_value(key);
+    if (t_p == nullptr) {
+      throw std::out_of_range("Key not found in hash map");
+    }
+    return *t_p;
+  }
+
+  size_type count(const key_type &key) const {
+    epoch_guard guard;
+    if (find_value(key) == nullptr)
+      return 0;
+
+    return 1;
+  }
+
+  bool contains(const key_type &key) const { return count(key) != 0; }
+
+  /////////////////////
+  // Lookup end      //
+  /////////////////////
+
+  ////////////////////////////
+  // Hash Policy      start //
+  ////////////////////////////
+
+  size_type bucket_count() const noexcept { return table_.load()->max_size; }
+  float max_load_factor() const { return max_load_factor_; }
+  void max_load_factor(float ml) {
+    std::lock_guard lock(writer_mutex_);
+    max_load_factor_ = ml;
+  }
+
+  /**
+   * @brief Builds a table with room for count items within max_load_factor(),
+   *        so that inserting them publishes no further tables
+   */
+  void reserve(size_type count) {
+    std::lock_guard lock(writer_mutex_);
+    auto needed = static_cast<size_type>(std::ceil(count / max_load_factor_));
+    auto newSize = std::max(std::bit_ceil(needed), kInitialBuckets);
+    if (newSize > table_.load()->max_size)
+      rebuild_table(newSize);
+  }
+
+  ////////////////////////////
+  // Hash Policy        end //
+  ////////////////////////////
+
+private:
+  struct table {
+    explicit table(size_type size)
+        : max_size{size}, container{std::make_unique<value_type[]>(size)} {}
+
+    size_type max_size;
+    std::unique_ptr<value_type[]> container;
+  };
+
+  std::atomic<table *> table_;
+  std::atomic<size_type> curr_size_ = 0;
+
+  // only touched with writer_mutex_ held
+  std::mutex writer_mutex_;
+  size_type tombstones_ = 0;
+  float max_load_factor_;
+  epoch_retire_list retired_;
+
+  [[no_unique_address]] hasher hash_fn_;
+  [[no_unique_address]] key_equal key_equal_fn_;
+  [[no_unique_address]] prober probe_fn_;
+  [[no_unique_address]] Index index_fn_;
+
+  static constexpr size_type kInitialBuckets = 4;
+
+  // retired objects are freed in batches, as every scan reads all reader slots
+  static constexpr size_type kReclaimThreshold = 64;
+
+  // address standing in for an erased value, never dereferenced
+  alignas(T) static inline std::byte tombstone_tag_ = {};
+
+  static T *tombstone() noexcept {
+    return reinterpret_cast<T *>(&tombstone_tag_);
+  }
+
+  static bool is_live(const T *t_p) noexcept {
+    return t_p != nullptr and t_p != tombstone();
+  }
+
+  static void delete_value(T *t_p) noexcept {
+    if (is_live(t_p))
+      delete t_p;
+  }
+
+  // All bucket pointer accesses racing with readers are sequentially
+  // consistent, so that a reader pinning its epoch after a value was retired
+  // is guaranteed to load the pointer that replaced it. Loads cost the same
+  // as acquire loads on x86 and ARM.
+
+  /**
+   * @brief Lock free probe for key over the current table, the caller must
+   *        hold an epoch_guard for as long as it uses the returned value
+   */
+  const T *find_value(const key_type &key) const {
+    auto tbl = table_.load();
+    auto mask = tbl->max_size - 1;
+    auto bucket = index_fn_(hash_fn_(key), tbl->max_size);
+
+    for (size_type probed = 0; probed < tbl->max_size; probed++) {
+      auto &node = tbl->container[bucket];
+      auto t_p = std::atomic_ref<T *>(node.t_p).load();
+      if (t_p == nullptr)
+        return nullptr;
+      // a published key never changes, so it is safe to read once t_p is set
+      if (key_equal_fn_(key, node.key))
+        return t_p == tombstone() ? nullptr : t_p;
+      bucket = (bucket + 1) & mask;
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * @brief Returns the bucket holding key, live or erased, otherwise the empty
+   *        bucket key goes into after growing the table if needed. Only the
+   *        writer mutates buckets, so it probes them with plain loads.
+   */
+  value_type &claim_bucket(const key_type &key) {
+    auto tbl = table_.load();
+    auto bucket = probe_fn_.find_item_key(tbl->container.get(), tbl->max_size,
+                                          key, hash_fn_, key_equal_fn_);
+    if (bucket != tbl->max_size)
+      return tbl->container[bucket];
+
+    expand_table_if_load_factor_reached();
+    tbl = table_.load();
+    bucket = probe_fn_.get_empty_bucket_index(
+        tbl->container.get(), tbl->max_size, key, hash_fn_, key_equal_fn_);
+    return tbl->container[bucket];
+  }
+
+  void publish_value(value_type &node, const key_type &key, T *t_p) {
+    // an empty bucket is invisible to readers until t_p is published
+    if (node.t_p == nullptr)
+      node.key = key;
+    else if (node.t_p == tombstone())
+      tombstones_--;
+
+    if (not is_live(node.t_p))
+      curr_size_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_ref<T *>(node.t_p).store(t_p);
+  }
+
+  // tombstones take up buckets just like live items, so they count towards
+  // the load factor until the table is rebuilt
+  void expand_table_if_load_factor_reached() {
+    auto maxSize = table_.load()->max_size;
+    auto used = size() + tombstones_ + 1;
+    if (static_cast<float>(used) / maxSize <= max_load_factor_)
+      return;
+
+    // purge tombstones in place if live items only fill half the table
+    auto live = static_cast<float>(size() + 1) / maxSize;
+    rebuild_table(live * 2 > max_load_factor_ ? maxSize * 2 : maxSize);
+  }
+
+  // copies live buckets into a new table, values are shared between both
+  void rebuild_table(size_type newSize) {
+    auto oldTable = table_.load();
+    auto newTable = new table(newSize);
+
+    for (size_type i = 0; i < oldTable->max_size; i++) {
+      auto &node = oldTable->container[i];
+      if (not is_live(node.t_p))
+        continue;
+
+      auto bucket =
+          probe_fn_.get_empty_bucket_index(newTable->container.get(), newSize,
+                                           node.key, hash_fn_, key_equal_fn_);
+      newTable->container[bucket].key = node.key;
+      newTable->container[bucket].t_p = node.t_p;
+    }
+
+    publish(newTable);
+    tombstones_ = 0;
+  }
+
+  // swaps in a new table, the old one is freed once no reader is left on it
+  void publish(table *newTable) {
+    auto oldTable = table_.exchange(newTable);
+    retired_.retire(oldTable,
+                    [](void *p) { delete static_cast<table *>(p); });
+    retired_.reclaim();
+  }
+
+  void retire_value(T *t_p) {
+    if (not is_live(t_p))
+      return;
+
+    retired_.retire(t_p, [](void *p) { delete static_cast<T *>(p); });
+    if (retired_.size() >= kReclaimThreshold)
+      retired_.reclaim();
+  }
+};
+
+}; // namespace nhzaci
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace nhzaci {
+
+/**
+ * @brief Process wide epoch based reclamation domain. Readers pin the current
+ *        epoch for the duration of a read through an epoch_guard, and writers
+ *        retire memory they unlinked into an epoch_retire_list, which frees it
+ *        once no reader can still be pinned to an epoch it was reachable in.
+ *
+ *        Every reader thread claims one cache line sized slot on its first
+ *        read, and gives it back when the thread exits.
+ */
+class epoch_domain {
+  struct reader_slot;
+
+public:
+  static constexpr size_t kMaxThreads = 256;
+  static constexpr std::uint64_t kIdle =
+      std::numeric_limits<std::uint64_t>::max();
+
+  static epoch_domain &instance() {
+    static epoch_domain domain;
+    return domain;
+  }
+
+  /**
+   * @brief Pins the calling thread to the current epoch, nested guards on
+   *        the same thread only pin on the outermost one
+   */
+  class epoch_guard {
+  public:
+    epoch_guard() : epoch_guard(epoch_domain::instance()) {}
+    explicit epoch_guard(epoch_domain &domain) : slot_{domain.local_slot()} {
+      if (slot_.depth++ == 0)
+        slot_.epoch.store(domain.epoch_.load());
+    }
+    ~epoch_guard() {
+      if (--slot_.depth == 0)
+        slot_.epoch.store(kIdle);
+    }
+
+    epoch_guard(const epoch_guard &) = delete;
+    epoch_guard &operator=(const epoch_guard &) = delete;
+
+  private:
+    reader_slot &slot_;
+  };
+
+  // bumps the global epoch, returning the epoch before the bump
+  std::uint64_t advance() noexcept { return epoch_.fetch_add(1); }
+
+  // smallest epoch a reader is pinned to, kIdle if no reader is reading
+  std::uint64_t min_pinned_epoch() const noexcept {
+    auto pinned = kIdle;
+    for (auto &slot : slots_)
+      pinned = std::min(pinned, slot.epoch.load());
+    return pinned;
+  }
+
+private:
+  struct alignas(64) reader_slot {
+    std::atomic<std::uint64_t> epoch{kIdle};
+    std::atomic<bool> claimed{false};
+    // only touched by the owning thread
+    size_t depth = 0;
+  };
+
+  // releases the slot of an exiting thread
+  struct slot_registration {
+    reader_slot *slot = nullptr;
+    ~slot_registration() {
+      if (slot != nullptr)
+        slot->claimed.store(false, std::memory_order_release);
+    }
+  };
+
+  std::atomic<std::uint64_t> epoch_{1};
+  reader_slot slots_[kMaxThreads];
+
+  epoch_domain() = default;
+
+  reader_slot &local_slot() {
+    thread_local slot_registration registration;
+    if (registration.slot != nullptr)
+      return *registration.slot;
+
+    for (auto &slot : slots_) {
+      bool expected = false;
+      if (slot.claimed.compare_exchange_strong(expected, true)) {
+        registration.slot = &slot;
+        return slot;
+      }
+    }
+
+    throw std::runtime_error("epoch_domain ran out of reader slots");
+  }
+};
+
+using epoch_guard = epoch_domain::epoch_guard;
+
+/**
+ * @brief Memory unlinked by a single writer, waiting for every reader that
+ *        may still see it to leave its epoch. Not thread safe, writers must
+ *        serialise access to it.
+ */
+class epoch_retire_list {
+public:
+  using deleter_t = void (*)(void *);
+
+  explicit epoch_retire_list(epoch_domain &domain = epoch_domain::instance())
+      : domain_{domain} {}
+  // the owner guarantees that no reader is left by the time it is destroyed
+  ~epoch_retire_list() { drain(); }
+
+  epoch_retire_list(const epoch_retire_list &) = delete;
+  epoch_retire_list &operator=(const epoch_retire_list &) = delete;
+
+  /**
+   * @brief Schedules p to be freed with deleter, p must already be
+   *        unreachable for readers starting from now on
+   */
+  void retire(void *p, deleter_t deleter) {
+    retired_.push_back({p, deleter, domain_.advance()});
+  }
+
+  // frees everything retired before the oldest epoch a reader is pinned to
+  void reclaim() {
+    auto pinned = domain_.min_pinned_epoch();
+    auto kept = std::partition(
+        retired_.begin(), retired_.end(),
+        [pinned](const retired &r) { return r.epoch >= pinned; });
+
+    for (auto itr = kept; itr != retired_.end(); itr++)
+      itr->deleter(itr->p);
+    retired_.erase(kept, retired_.end());
+  }
+
+  // frees everything regardless of readers
+  void drain() {
+    for (auto &r : retired_)
+      r.deleter(r.p);
+    retired_.clear();
+  }
+
+  size_t size() const noexcept { return retired_.size(); }
+
+private:
+  struct retired {
+    void *p;
+    deleter_t deleter;
+    std::uint64_t epoch;
+  };
+
+  epoch_domain &domain_;
+  std::vector<retired> retired_;
+};
+
+}; // namespace nhzaci
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "MapNode.hxx"
+#include "OpenAddressedHashMap.hxx"
+
+namespace nhzaci {
+
+namespace detail {
+
+// murmur3's 64-bit finalizer, every input bit flips every output bit with
+// probability close to 1/2
+constexpr uint64_t frozen_mix(uint64_t x) noexcept {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// maps a 64-bit hash uniformly onto [0, n) with a multiply instead of a modulo
+constexpr size_t fast_range(uint64_t hash, size_t n) noexcept {
+  return static_cast<size_t>((static_cast<unsigned __int128>(hash) * n) >> 64);
+}
+
+// little endian word of the first len <= 8 bytes at p, the same at compile
+// time and at run time
+constexpr uint64_t load_word(const char *p, size_t len) noexcept {
+  if (not std::is_constant_evaluated() and len == 8 and
+      std::endian::native == std::endian::little) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+  }
+
+  uint64_t word = 0;
+  for (size_t i = 0; i < len; i++)
+    word |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+  return word;
+}
+
+// keys sharing a bucket are displaced together, more keys per bucket shrink
+// the displacement table but make buckets harder to place
+inline constexpr size_t kFrozenKeysPerBucket = 2;
+
+constexpr size_t frozen_bucket_count(size_t n) noexcept {
+  return n / kFrozenKeysPerBucket + 1;
+}
+
+}; // namespace detail
+
+/**
+ * @brief Seeded hash function of frozen_hash_map, usable in constant
+ *        expressions. Building a perfect hash retries with new seeds until
+ *        every key lands in a slot of its own, so frozen_hash_map needs a
+ *        family of hash functions rather than std::hash's single one.
+ *
+ *        Specialised for integers, enums, std::string_view and std::string,
+ *        other keys need their own hash with the same call signature.
+ */
+template <typename Key> struct frozen_hash;
+
+template <typename Key>
+  requires(std::is_integral_v<Key> or std::is_enum_v<Key>)
+struct frozen_hash<Key> {
+  constexpr uint64_t operator()(Key key, uint64_t seed) const noexcept {
+    return detail::frozen_mix(static_cast<uint64_t>(key) +
+                              seed * 0x9E3779B97F4A7C15ull);
+  }
+};
+
+template <> struct frozen_hash<std::string_view> {
+  constexpr uint64_t operator()(std::string_view key,
+                                uint64_t seed) const noexcept {
+    uint64_t hash = seed * 0x9E3779B97F4A7C15ull ^ key.size();
+    size_t i = 0;
+    for (; i + 8 <= key.size(); i += 8)
+      hash = detail::frozen_mix(hash ^ detail::load_word(key.data() + i, 8));
+    return detail::frozen_mix(
+        hash ^ detail::load_word(key.data() + i, key.size() - i));
+  }
+};
+
+template <> struct frozen_hash<std::string> : frozen_hash<std::string_view> {};
+
+/**
+ * @brief Immutable hash map over a fixed set of keys, with a minimal perfect
+ *        hash (hash and displace, as in CHD) built over them. Every key gets
+ *        a slot of its own and there are exactly as many slots as keys, so a
+ *        lookup is one hash, one read of the bucket's displacement, one slot
+ *        probe and one key compare, hit or miss.
+ *
+ *        With a fixed N the map is a literal type, built in a constant
+ *        expression by make_frozen_hash_map. Otherwise N is
+ *        std::dynamic_extent and the map is built at run time, from a list of
+ *        items or from an open_addressed_hash_map.
+ *
+ * @tparam Key        Type of key objects
+ * @tparam T          Type of mapped objects
+ * @tparam N          Number of items, std::dynamic_extent if only known at
+ * run time
+ * @tparam Hash       Seeded hash function object type, defaults to
+ * frozen_hash<Key>
+ * @tparam KeyEqual   Predicate function object type, defaults to
+ * std::equal_to<Key>
+ */
+template <typename Key, typename T, size_t N = std::dynamic_extent,
+          typename Hash = frozen_hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class frozen_hash_map {
+  template <typename U, size_t Extent>
+  using storage = std::conditional_t<Extent == std::dynamic_extent,
+                                     std::vector<U>, std::array<U, Extent>>;
+
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = InlineMapNode<Key, T>;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  // slots are never empty, so iterating is walking the slot array
+  using iterator = const value_type *;
+  using const_iterator = const value_type *;
+
+  constexpr const_iterator begin() const { return slots_.data(); }
+  constexpr const_iterator end() const { return slots_.data() + slots_.size(); }
+
+  /////////////////////
+  // Special Mem Fns //
+  /////////////////////
+
+  /**
+   * @brief Builds the perfect hash over items, in a constant expression if N
+   *        is fixed
+   *
+   * @param items   (key, value) pairs, keys must be unique
+   * @throws std::invalid_argument  if a key appears twice
+   */
+  constexpr explicit frozen_hash_map(
+      std::span<const std::pair<Key, T>, N> items,
+      const hasher &hash_f = hasher(),
+      const key_equal &equal_to_f = key_equal())
+      : hash_fn_{hash_f}, key_eq_fn_{equal_to_f} {
+    build(
+        items.size(), [&](size_type i) -> const Key & { return items[i].first; },
+        [&](size_type i) -> const T & { return items[i].second; });
+  }
+
+  /**
+   * @brief Builds the perfect hash over every item of map, which stays
+   *        untouched
+   */
+  template <typename... Args>
+    requires(N == std::dynamic_extent)
+  explicit frozen_hash_map(const open_addressed_hash_map<Key, T, Args...> &map,
+                           const hasher &hash_f = hasher(),
+                           const key_equal &equal_to_f = key_equal())
+      : hash_fn_{hash_f}, key_eq_fn_{equal_to_f} {
+    std::vector<const typename open_addressed_hash_map<Key, T,
+                                                       Args...>::value_type *>
+        nodes;
+    for (auto &node : map)
+      nodes.push_back(&node);
+
+    build(
+        nodes.size(), [&](size_type i) -> const Key & { return nodes[i]->key; },
+        [&](size_type i) -> const T & { return nodes[i]->value(); });
+  }
+
+  /////////////////////
+  // Capacity  start //
+  /////////////////////
+
+  constexpr bool empty() const { return slots_.empty(); }
+
+  constexpr size_t size() const { return slots_.size(); }
+
+  // every slot holds an item
+  constexpr size_t max_size() const { return slots_.size(); }
+
+  /////////////////////
+  // Capacity  end   //
+  /////////////////////
+
+  /////////////////////
+  // Lookup start    //
+  /////////////////////
+
+  constexpr const T &at(const key_type &key) const {
+    auto node = find_node(key);
+
+    if (node == nullptr) {
+      throw std::out_of_range("Key not found in hash map");
+    }
+
+    return node->value();
+  }
+
+  constexpr size_type count(const key_type &key) const {
+    if (find_node(key) == nullptr)
+      return 0;
+
+    return 1;
+  }
+
+  constexpr const_iterator find(const key_type &key) const {
+    auto node = find_node(key);
+    return node == nullptr ? end() : node;
+  }
+
+  constexpr bool contains(const key_type &key) const {
+    return find_node(key) != nullptr;
+  }
+
+  /////////////////////
+  // Lookup end      //
+  /////////////////////
+
+  ////////////////////////////
+  // Observers        start //
+  ////////////////////////////
+
+  constexpr hasher hash_function() const { return hash_fn_; }
+  constexpr key_equal key_eq() const { return key_eq_fn_; }
+
+  ////////////////////////////
+  // Observers        end   //
+  ////////////////////////////
+
+private:
+  // displacements with this bit set hold the slot of their bucket's only key
+  static constexpr uint32_t kDirect = uint32_t(1) << 31;
+  // displacements tried per bucket before giving up on a seed
+  static constexpr uint32_t kMaxDisplacement = 1 << 20;
+  static constexpr uint64_t kMaxSeeds = 64;
+
+  storage<value_type, N> slots_{};
+  storage<uint32_t, N == std::dynamic_extent ? N : detail::frozen_bucket_count(N)>
+      displacements_{};
+  uint64_t seed_ = 0;
+  hasher hash_fn_;
+  key_equal key_eq_fn_;
+
+  static constexpr size_type displaced_slot(uint64_t hash, uint32_t d,
+                                            size_type n) noexcept {
+    return detail::fast_range((hash ^ d) * 0x9E3779B97F4A7C15ull, n);
+  }
+
+  constexpr const value_type *find_node(const key_type &key) const {
+    if (slots_.empty())
+      return nullptr;
+
+    auto hash = hash_fn_(key, seed_);
+    auto d = displacements_[detail::fast_range(hash, displacements_.size())];
+    // selected without a branch, a mispredicted one would throw away the
+    // slot loads of the lookups after it
+    size_type direct = -static_cast<size_type>(d >> 31);
+    auto slot = (direct & (d & ~kDirect)) |
+                (~direct & displaced_slot(hash, d, slots_.size()));
+
+    auto node = &slots_[slot];
+    return key_eq_fn_(key, node->key) ? node : nullptr;
+  }
+
+  template <typename KeyAt, typename ValueAt>
+  constexpr void build(size_type n, KeyAt key_at, ValueAt value_at) {
+    if (n >= kDirect)
+      throw std::length_error("Too many keys for a frozen_hash_map");
+
+    if constexpr (N == std::dynamic_extent) {
+      slots_.resize(n);
+      displacements_.resize(detail::frozen_bucket_count(n));
+    }
+    if (n == 0)
+      return;
+
+    auto slot_of = place_keys(n, key_at);
+    for (size_type i = 0; i < n; i++)
+      slots_[slot_of[i]] = value_type(key_at(i), value_at(i));
+  }
+
+  /**
+   * @brief Finds a seed and a displacement for every bucket that send the n
+   *        keys to n different slots. Buckets are placed largest first, each
+   *        trying displacements until all of its keys land in free slots,
+   *        then buckets of a single key take the remaining slots directly.
+   *
+   * @return std::vector<size_type>  slot of every key
+   */
+  template <typename KeyAt>
+  constexpr std::vector<size_type> place_keys(size_type n, KeyAt key_at) {
+    auto buckets = displacements_.size();
+    std::vector<uint64_t> hashes(n);
+    // keys grouped by bucket, those of bucket b start at members[first[b]]
+    std::vector<size_type> members(n);
+    std::vector<size_type> first(buckets + 1);
+    std::vector<size_type> order(buckets);
+    std::vector<size_type> slot_of(n);
+    std::vector<bool> taken(n);
+
+    auto bucket_size = [&](size_type b) { return first[b + 1] - first[b]; };
+
+    // false if this seed leaves some bucket without a displacement
+    auto place_buckets = [&]() {
+      for (auto b : order) {
+        auto begin = first[b], end = first[b + 1];
+        if (end - begin < 2)
+          break;
+
+        // keys with equal hashes never separate, whatever the displacement
+        for (auto i = begin; i < end; i++) {
+          for (auto j = i + 1; j < end; j++) {
+            if (hashes[members[i]] != hashes[members[j]])
+              continue;
+            if (key_eq_fn_(key_at(members[i]), key_at(members[j])))
+              throw std::invalid_argument("Duplicate key in frozen_hash_map");
+            return false;
+          }
+        }
+
+        bool found = false;
+        for (uint32_t d = 0; d < kMaxDisplacement and not found; d++) {
+          found = true;
+          for (auto m = begin; m < end and found; m++) {
+            auto slot = displaced_slot(hashes[members[m]], d, n);
+            found = not taken[slot];
+            for (auto prev = begin; prev < m and found; prev++)
+              found = slot_of[members[prev]] != slot;
+            slot_of[members[m]] = slot;
+          }
+          if (found)
+            displacements_[b] = d;
+        }
+        if (not found)
+          return false;
+
+        for (auto m = begin; m < end; m++)
+          taken[slot_of[members[m]]] = true;
+      }
+      return true;
+    };
+
+    for (uint64_t seed = 0; seed < kMaxSeeds; seed++) {
+      std::fill(first.begin(), first.end(), 0);
+      for (size_type i = 0; i < n; i++) {
+        hashes[i] = hash_fn_(key_at(i), seed);
+        first[detail::fast_range(hashes[i], buckets) + 1]++;
+      }
+      for (size_type b = 0; b < buckets; b++)
+        first[b + 1] += first[b];
+
+      auto next = first;
+      for (size_type i = 0; i < n; i++)
+        members[next[detail::fast_range(hashes[i], buckets)]++] = i;
+
+      std::iota(order.begin(), order.end(), size_type(0));
+      std::sort(order.begin(), order.end(), [&](size_type a, size_type b) {
+        return bucket_size(a) > bucket_size(b);
+      });
+      std::fill(taken.begin(), taken.end(), false);
+
+      if (not place_buckets())
+        continue;
+
+      size_type free_slot = 0;
+      for (size_type b = 0; b < buckets; b++) {
+        if (bucket_size(b) == 0) {
+          displacements_[b] = 0;
+        } else if (bucket_size(b) == 1) {
+          while (taken[free_slot])
+            free_slot++;
+          taken[free_slot] = true;
+          slot_of[members[first[b]]] = free_slot;
+          displacements_[b] = kDirect | static_cast<uint32_t>(free_slot);
+        }
+      }
+
+      seed_ = seed;
+      return slot_of;
+    }
+
+    throw std::runtime_error("No perfect hash found for frozen_hash_map keys");
+  }
+};
+
+/**
+ * @brief Builds a frozen_hash_map from a list of items, usable in constant
+ *        expressions, e.g.
+ *
+ *        constexpr auto codes =
+ *            make_frozen_hash_map<std::string_view, int>({{"XNYS", 1},
+ *                                                         {"XLON", 2}});
+ */
+template <typename Key, typename T, size_t N>
+constexpr frozen_hash_map<Key, T, N>
+make_frozen_hash_map(const std::pair<Key, T> (&items)[N]) {
+  return frozen_hash_map<Key, T, N>(std::span<const std::pair<Key, T>, N>(items));
+}
+
+}; // namespace nhzaci
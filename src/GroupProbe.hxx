@@ -0,0 +1,372 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// defining NHZACI_GROUP_PROBE_SCALAR forces the scalar control_group even
+// when SIMD is available
+#if !defined(NHZACI_GROUP_PROBE_SCALAR) &&                                    \
+    (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
+#include "Probe.hxx"
+
+namespace nhzaci {
+
+/**
+ * @brief A group of control bytes loaded from the control array, matched
+ *        against a 7-bit hash fragment or the empty/deleted markers. Every
+ *        match returns a bitmask where bit i refers to the i-th slot of the
+ *        group.
+ *
+ *        Uses AVX2 (32 slots) or SSE2 (16 slots) when available, otherwise
+ *        falls back to a scalar loop over 16 slots, which can also be forced
+ *        by defining NHZACI_GROUP_PROBE_SCALAR.
+ */
+struct control_group {
+  using ctrl_t = std::int8_t;
+  using mask_t = std::uint32_t;
+
+  static constexpr ctrl_t kEmpty = -128;  // 0b10000000
+  static constexpr ctrl_t kDeleted = -2;  // 0b11111110
+
+#if defined(__AVX2__) && !defined(NHZACI_GROUP_PROBE_SCALAR)
+  static constexpr size_t kWidth = 32;
+
+  explicit control_group(const ctrl_t *pos)
+      : ctrl_{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos))} {}
+
+  mask_t match(ctrl_t h2) const noexcept {
+    return static_cast<mask_t>(_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_set1_epi8(h2), ctrl_)));
+  }
+
+  mask_t match_empty() const noexcept { return match(kEmpty); }
+
+  // empty and deleted are the only control bytes with the sign bit set
+  mask_t match_empty_or_deleted() const noexcept {
+    return static_cast<mask_t>(_mm256_movemask_epi8(ctrl_));
+  }
+
+private:
+  __m256i ctrl_;
+#elif defined(__SSE2__) && !defined(NHZACI_GROUP_PROBE_SCALAR)
+  static constexpr size_t kWidth = 16;
+
+  explicit control_group(const ctrl_t *pos)
+      : ctrl_{_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos))} {}
+
+  mask_t match(ctrl_t h2) const noexcept {
+    return static_cast<mask_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+  }
+
+  mask_t match_empty() const noexcept { return match(kEmpty); }
+
+  // empty and deleted are the only control bytes with the sign bit set
+  mask_t match_empty_or_deleted() const noexcept {
+    return static_cast<mask_t>(_mm_movemask_epi8(ctrl_));
+  }
+
+private:
+  __m128i ctrl_;
+#else
+  static constexpr size_t kWidth = 16;
+
+  explicit control_group(const ctrl_t *pos) {
+    std::memcpy(ctrl_, pos, kWidth);
+  }
+
+  mask_t match(ctrl_t h2) const noexcept {
+    mask_t mask = 0;
+    for (size_t i = 0; i < kWidth; i++)
+      mask |= static_cast<mask_t>(ctrl_[i] == h2) << i;
+    return mask;
+  }
+
+  mask_t match_empty() const noexcept { return match(kEmpty); }
+
+  mask_t match_empty_or_deleted() const noexcept {
+    mask_t mask = 0;
+    for (size_t i = 0; i < kWidth; i++)
+      mask |= static_cast<mask_t>(ctrl_[i] < 0) << i;
+    return mask;
+  }
+
+private:
+  ctrl_t ctrl_[kWidth];
+#endif
+};
+
+/**
+ * @brief Probing function object that keeps a control byte per bucket next
+ *        to the hash map's container, holding either a 7-bit fragment of the
+ *        key's hash or an empty/deleted marker. Probing scans a whole
+ *        control_group at a time, so only buckets whose fragment matches are
+ *        loaded and compared by key, and a miss usually costs a single group
+ *        load.
+ *
+ *        The control array has control_group::kWidth - 1 trailing bytes
+ *        mirroring the start of the array, so a group can be loaded from any
+ *        bucket without wrapping. Requires max_size to be a power of two.
+ *        Home buckets always come from a mixed hash, as the low 7 bits are
+ *        used as the fragment.
+ *
+ * @tparam Key        Type of key object
+ * @tparam ValueType  Type of mapped object
+ * @tparam Hash       Hash function object from hash map
+ * @tparam KeyEqual   Predicate function object from hash map
+ */
+template <typename Key, typename ValueType, typename Hash, typename KeyEqual>
+struct group_probe {
+  using value_type_p = ValueType *;
+  using const_value_type_p = const ValueType *;
+  using const_hasher_ref = const Hash &;
+  using const_key_ref = const Key &;
+  using const_key_equal_ref = const KeyEqual &;
+  using ctrl_t = control_group::ctrl_t;
+
+  static constexpr size_t kWidth = control_group::kWidth;
+
+  /**
+   * @brief Allocates a fresh control array for an empty container, must be
+   *        called whenever the hash map swaps in a new container
+   *
+   * @param max_size    max number of elements the new container contains
+   */
+  void resize(size_t max_size) {
+    allocate(max_size);
+    initialize(max_size, 0, max_size);
+  }
+
+  // resize split in two, leaving buckets uninitialized until initialize
+  // marks [first, last) empty, the mirror is set along with the last bucket
+  void allocate(size_t max_size) {
+    ctrl_ = std::make_unique_for_overwrite<ctrl_t[]>(max_size + kWidth - 1);
+    deleted_ = 0;
+  }
+  void initialize(size_t max_size, size_t first, size_t last) noexcept {
+    if (last == max_size)
+      last += kWidth - 1;
+    std::memset(ctrl_.get() + first, control_group::kEmpty, last - first);
+  }
+
+  void clear() noexcept {
+    ctrl_.reset();
+    deleted_ = 0;
+  }
+
+  // deleted buckets lengthen probes as much as full ones, so the hash map
+  // counts them towards its load factor
+  size_t deleted() const noexcept { return deleted_; }
+
+  /**
+   * @brief Probe and return index for the bucket holding key if it exists,
+   *        otherwise the first empty or deleted bucket, whose control byte is
+   *        claimed for key before returning
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to add in
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of groups loaded
+   * @return size_t     returns bucket key should be written into, or
+   *                    max_size if the table has no free bucket left
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t get_empty_bucket_index(value_type_p container, size_t max_size,
+                                const_key_ref key, const_hasher_ref hash_f,
+                                const_key_equal_ref equal_to_f,
+                                OnProbed on_probed = {}) noexcept {
+    auto hash = detail::mix_hash(hash_f(key));
+    auto h2 = fragment(hash);
+    auto mask = max_size - 1;
+    auto bucket = (hash >> 7) & mask;
+    auto target = max_size;
+    size_t groups = 0;
+
+    for (size_t probed = 0; probed < max_size; probed += kWidth) {
+      control_group group(ctrl_.get() + bucket);
+      groups++;
+
+      for (auto match = group.match(h2); match != 0; match &= match - 1) {
+        auto idx = (bucket + std::countr_zero(match)) & mask;
+        if (equal_to_f(key, container[idx].key)) {
+          on_probed(groups);
+          return idx;
+        }
+      }
+
+      // remember the first free bucket, but keep going until an empty
+      // bucket proves key is not further along
+      if (target == max_size) {
+        if (auto free = group.match_empty_or_deleted(); free != 0)
+          target = (bucket + std::countr_zero(free)) & mask;
+      }
+
+      if (group.match_empty() != 0)
+        break;
+      bucket = (bucket + kWidth) & mask;
+    }
+
+    // callers grow the table before its last free bucket is taken, so a full
+    // table means a broken caller, and max_size must never be indexed
+    assert(target != max_size && "group_probe: no free bucket left");
+    if (target != max_size) {
+      deleted_ -= ctrl_[target] == control_group::kDeleted;
+      set_ctrl(target, h2, max_size);
+    }
+    on_probed(groups);
+    return target;
+  }
+
+  /**
+   * @brief Probe for a certain key, returning max_size if no match is found
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to find
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of groups loaded
+   * @return size_t     max_size if not found, otherwise index to item
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_key(value_type_p container, size_t max_size,
+                       const_key_ref key, const_hasher_ref hash_f,
+                       const_key_equal_ref equal_to_f,
+                       OnProbed on_probed = {}) const noexcept {
+    return find_item_hashed(container, max_size, key, hash_f(key), equal_to_f,
+                            on_probed);
+  }
+
+  /**
+   * @brief find_item_key for a key whose hash is already known
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to find
+   * @param hash        hash_f(key), unmixed
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of groups loaded
+   * @return size_t     max_size if not found, otherwise index to item
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_hashed(value_type_p container, size_t max_size,
+                          const_key_ref key, size_t hash,
+                          const_key_equal_ref equal_to_f,
+                          OnProbed on_probed = {}) const noexcept {
+    hash = detail::mix_hash(hash);
+    auto h2 = fragment(hash);
+    auto mask = max_size - 1;
+    auto bucket = (hash >> 7) & mask;
+    size_t groups = 0;
+
+    // bounded by the number of groups so that a table saturated with deleted
+    // buckets still terminates
+    for (size_t probed = 0; probed < max_size; probed += kWidth) {
+      control_group group(ctrl_.get() + bucket);
+      groups++;
+
+      for (auto match = group.match(h2); match != 0; match &= match - 1) {
+        auto idx = (bucket + std::countr_zero(match)) & mask;
+        if (equal_to_f(key, container[idx].key)) {
+          on_probed(groups);
+          return idx;
+        }
+      }
+
+      if (group.match_empty() != 0)
+        break;
+      bucket = (bucket + kWidth) & mask;
+    }
+
+    on_probed(groups);
+    return max_size;
+  }
+
+  // pulls the first control group of a hash into cache, along with its home
+  // node as most hits land in the first slots of the group
+  void prefetch(value_type_p container, size_t max_size,
+                size_t hash) const noexcept {
+    auto bucket = (detail::mix_hash(hash) >> 7) & (max_size - 1);
+    detail::prefetch(ctrl_.get() + bucket);
+    detail::prefetch(container + bucket);
+  }
+
+  /**
+   * @brief Releases the control byte of an emptied bucket. The bucket goes
+   *        back to empty if every group window covering it still has an
+   *        empty bucket, as then no probe can ever have passed through it,
+   *        otherwise it is marked deleted so that probes keep going.
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param bucket      bucket whose node has already been emptied
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   */
+  void erase_bucket([[maybe_unused]] value_type_p container, size_t max_size,
+                    size_t bucket, [[maybe_unused]] const_hasher_ref hash_f,
+                    [[maybe_unused]] const_key_equal_ref equal_to_f) noexcept {
+    free_bucket(bucket, max_size);
+  }
+
+  /**
+   * @brief Releases an emptied bucket just like erase_bucket, as the
+   *        container is being drained. Going back to empty wherever possible
+   *        keeps lookups into the drained part short, and probes only read
+   *        nodes under full control bytes, so the node is never read again
+   *        and the hash map is free to destroy it.
+   *
+   * @param max_size    max number of elements container contains
+   * @param bucket      bucket whose node has already been emptied
+   */
+  void release_bucket(value_type_p, size_t max_size, size_t bucket) noexcept {
+    free_bucket(bucket, max_size);
+  }
+
+private:
+  std::unique_ptr<ctrl_t[]> ctrl_;
+  size_t deleted_ = 0;
+
+  void free_bucket(size_t bucket, size_t max_size) noexcept {
+    auto mask = max_size - 1;
+    auto empty_after = control_group(ctrl_.get() + bucket).match_empty();
+    auto empty_before =
+        control_group(ctrl_.get() + ((bucket - kWidth) & mask)).match_empty();
+
+    // leading zeros counted within the group width rather than the mask type
+    auto leading_before = std::countl_zero(static_cast<control_group::mask_t>(
+        empty_before << (32 - kWidth)));
+    bool was_never_full =
+        empty_before != 0 and empty_after != 0 and
+        static_cast<size_t>(std::countr_zero(empty_after) + leading_before) <
+            kWidth;
+
+    deleted_ += not was_never_full;
+    set_ctrl(bucket, was_never_full ? control_group::kEmpty
+                                    : control_group::kDeleted,
+             max_size);
+  }
+
+  static ctrl_t fragment(size_t hash) noexcept {
+    return static_cast<ctrl_t>(hash & 0x7F);
+  }
+
+  void set_ctrl(size_t bucket, ctrl_t h, size_t max_size) noexcept {
+    ctrl_[bucket] = h;
+    // keep the trailing mirror in sync, tables smaller than a group are
+    // mirrored more than once
+    for (auto i = bucket + max_size; i < max_size + kWidth - 1; i += max_size)
+      ctrl_[i] = h;
+  }
+};
+
+}; // namespace nhzaci
@@ -1,9 +1,19 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <ostream>
 #include <type_traits>
+#include <utility>
 
 namespace nhzaci {
 
+/**
+ * @brief How a node stores its mapped object, the hash map manages the
+ *        lifetime of pooled values itself as the node does not own them
+ */
+enum class node_storage { heap, inline_value, pooled };
+
 /**
  * @brief MapNode holds the key and pointer to a value in a hash map
  *
@@ -17,6 +27,8 @@ struct MapNode {
   static_assert(std::is_default_constructible_v<T>,
                 "Mapped object T of a MapNode must be default constructible");
 
+  static constexpr node_storage storage = node_storage::heap;
+
   // TODO: Add template concept for Key to be default constructible
   MapNode() : key{}, t_p{nullptr} {};
 
@@ -55,10 +67,120 @@ struct MapNode {
       Deleter()(t_p);
   }
 
+  bool occupied() const noexcept { return t_p != nullptr; }
+  T &value() noexcept { return *t_p; }
+  const T &value() const noexcept { return *t_p; }
+
+  // releases the owned value, leaving an empty bucket
+  void reset() {
+    if (t_p != nullptr)
+      Deleter()(t_p);
+    t_p = nullptr;
+  }
+
   friend inline std::ostream &operator<<(std::ostream &os,
                                          const MapNode &node) {
     return os << "MapNode(key=" << node.key << ";t_p=" << node.t_p << ")";
   }
 };
 
+/**
+ * @brief InlineMapNode holds the key and the value itself in a hash map, so
+ *        a lookup touches a single bucket and inserting allocates nothing.
+ *        Trivially copyable whenever Key and T are, and usable in constant
+ *        expressions whenever they are literal types.
+ *
+ * @tparam Key  Type of key objects, must be default contructible
+ * @tparam T    Type of mapped objects, must be default constructible
+ */
+template <typename Key, typename T> struct InlineMapNode {
+  static_assert(std::is_default_constructible_v<Key>,
+                "Key of a MapNode must be default constructible");
+  static_assert(std::is_default_constructible_v<T>,
+                "Mapped object T of a MapNode must be default constructible");
+
+  static constexpr node_storage storage = node_storage::inline_value;
+
+  constexpr InlineMapNode() : key{}, t{}, is_occupied{false} {};
+
+  // used in operator[] of hash map, default construct with some key
+  // and default construction of T
+  constexpr InlineMapNode(Key k) : key{k}, t{}, is_occupied{true} {};
+
+  constexpr InlineMapNode(Key k, T v)
+      : key{k}, t{std::move(v)}, is_occupied{true} {};
+
+  Key key;
+  T t;
+  bool is_occupied;
+
+  constexpr bool occupied() const noexcept { return is_occupied; }
+  constexpr T &value() noexcept { return t; }
+  constexpr const T &value() const noexcept { return t; }
+
+  // releases whatever the value holds on to, leaving an empty bucket
+  void reset() {
+    if constexpr (not std::is_trivially_destructible_v<T>)
+      t = T{};
+    is_occupied = false;
+  }
+
+  friend inline std::ostream &operator<<(std::ostream &os,
+                                         const InlineMapNode &node) {
+    return os << "InlineMapNode(key=" << node.key
+              << ";occupied=" << node.is_occupied << ")";
+  }
+};
+
+/**
+ * @brief PooledMapNode holds the key and a pointer to a value living in the
+ *        hash map's value_pool. The node does not own the value, copying it
+ *        only copies the pointer and the hash map creates and destroys values
+ *        through its pool.
+ *
+ * @tparam Key  Type of key objects, must be default contructible
+ * @tparam T    Type of mapped objects, must be default constructible
+ */
+template <typename Key, typename T> struct PooledMapNode {
+  static_assert(std::is_default_constructible_v<Key>,
+                "Key of a MapNode must be default constructible");
+  static_assert(std::is_default_constructible_v<T>,
+                "Mapped object T of a MapNode must be default constructible");
+
+  static constexpr node_storage storage = node_storage::pooled;
+
+  PooledMapNode() : key{}, t_p{nullptr} {};
+
+  PooledMapNode(Key k, T *t) : key{k}, t_p{t} {};
+
+  Key key;
+  T *t_p;
+
+  bool occupied() const noexcept { return t_p != nullptr; }
+  T &value() noexcept { return *t_p; }
+  const T &value() const noexcept { return *t_p; }
+
+  // the value belongs to the pool, so this only empties the bucket
+  void reset() noexcept { t_p = nullptr; }
+
+  friend inline std::ostream &operator<<(std::ostream &os,
+                                         const PooledMapNode &node) {
+    return os << "PooledMapNode(key=" << node.key << ";t_p=" << node.t_p
+              << ")";
+  }
+};
+
+// largest mapped object select_map_node still stores inline
+inline constexpr size_t kInlineValueMaxSize = 32;
+
+/**
+ * @brief Stores small trivially copyable values inline in the bucket, and
+ *        everything else in a value_pool
+ */
+template <typename Key, typename T>
+using select_map_node =
+    std::conditional_t<std::is_trivially_copyable_v<T> and
+                           sizeof(T) <= kInlineValueMaxSize,
+                       InlineMapNode<Key, T>, PooledMapNode<Key, T>>;
+
 }; // namespace nhzaci
\ No newline at end of file
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace nhzaci {
+
+/**
+ * @brief Histogram of probe lengths, the number of buckets (or groups, for
+ *        group_probe) a probe visited. Lengths of kMaxLength and over share
+ *        the last bin, longest keeps the exact maximum.
+ */
+struct probe_histogram {
+  static constexpr size_t kMaxLength = 64;
+
+  // counts[n] probes of length n, counts[0] stays empty
+  std::array<size_t, kMaxLength + 1> counts{};
+  size_t total = 0;
+  size_t sum = 0;
+  size_t longest = 0;
+
+  void record(size_t length) noexcept {
+    counts[std::min(length, kMaxLength)]++;
+    total++;
+    sum += length;
+    longest = std::max(longest, length);
+  }
+
+  double mean() const noexcept {
+    return total == 0 ? 0 : static_cast<double>(sum) / total;
+  }
+
+  // smallest length at least a fraction p of probes did not exceed
+  size_t percentile(double p) const noexcept {
+    size_t seen = 0;
+    for (size_t length = 1; length <= kMaxLength; length++) {
+      seen += counts[length];
+      if (seen > 0 and seen >= p * total)
+        return length;
+    }
+    return longest;
+  }
+};
+
+/**
+ * @brief probe_histogram that lookups running on several threads at once can
+ *        record into, every counter being a relaxed atomic. A copy taken
+ *        while lookups run may be off by the probes in flight, but never
+ *        loses one.
+ */
+struct shared_probe_histogram {
+  static constexpr size_t kMaxLength = probe_histogram::kMaxLength;
+
+  std::array<std::atomic<size_t>, kMaxLength + 1> counts{};
+  std::atomic<size_t> total = 0;
+  std::atomic<size_t> sum = 0;
+  std::atomic<size_t> longest = 0;
+
+  shared_probe_histogram() = default;
+  shared_probe_histogram(const shared_probe_histogram &other) noexcept {
+    *this = other;
+  }
+  shared_probe_histogram &
+  operator=(const shared_probe_histogram &other) noexcept {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    for (size_t length = 0; length <= kMaxLength; length++)
+      counts[length].store(other.counts[length].load(relaxed), relaxed);
+    total.store(other.total.load(relaxed), relaxed);
+    sum.store(other.sum.load(relaxed), relaxed);
+    longest.store(other.longest.load(relaxed), relaxed);
+    return *this;
+  }
+
+  void record(size_t length) noexcept {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    counts[std::min(length, kMaxLength)].fetch_add(1, relaxed);
+    total.fetch_add(1, relaxed);
+    sum.fetch_add(length, relaxed);
+    auto seen = longest.load(relaxed);
+    while (seen < length and
+           not longest.compare_exchange_weak(seen, length, relaxed))
+      ;
+  }
+
+  probe_histogram load() const noexcept {
+    constexpr auto relaxed = std::memory_order_relaxed;
+    probe_histogram histogram;
+    for (size_t length = 0; length <= kMaxLength; length++)
+      histogram.counts[length] = counts[length].load(relaxed);
+    histogram.total = total.load(relaxed);
+    histogram.sum = sum.load(relaxed);
+    histogram.longest = longest.load(relaxed);
+    return histogram;
+  }
+};
+
+/**
+ * @brief Lengths of the runs of occupied buckets in a table, counts[n] being
+ *        the number of clusters of length n
+ */
+struct cluster_distribution {
+  std::vector<size_t> counts;
+  size_t clusters = 0;
+  size_t occupied = 0;
+  size_t longest = 0;
+
+  void record(size_t length) {
+    if (counts.size() <= length)
+      counts.resize(length + 1);
+    counts[length]++;
+    clusters++;
+    occupied += length;
+    longest = std::max(longest, length);
+  }
+
+  double mean() const noexcept {
+    return clusters == 0 ? 0 : static_cast<double>(occupied) / clusters;
+  }
+};
+
+/**
+ * @brief Point in time copy of everything a hash map instrumented with
+ *        map_stats has recorded, along with its current footprint
+ */
+struct map_stats_snapshot {
+  probe_histogram hits;
+  probe_histogram misses;
+  probe_histogram inserts;
+  size_t longest_probe = 0;
+  size_t resizes = 0;
+  std::chrono::nanoseconds rehash_time{0};
+
+  size_t size = 0;
+  size_t bucket_count = 0;
+  // buckets of the container, and of the old one during incremental rehash
+  size_t slot_bytes = 0;
+  // values stored out of the buckets, on the heap or in a value_pool
+  size_t value_bytes = 0;
+};
+
+/**
+ * @brief Instrumentation policy recording nothing, every hook is empty so an
+ *        uninstrumented hash map compiles down to the same code as before
+ */
+struct no_map_stats {
+  static constexpr bool enabled = false;
+
+  struct rehash_timer {};
+
+  void record_lookup(size_t, bool) const noexcept {}
+  void record_insert(size_t) noexcept {}
+  void record_resize() noexcept {}
+  rehash_timer time_rehash() noexcept { return {}; }
+};
+
+/**
+ * @brief Instrumentation policy recording probe lengths of every lookup and
+ *        insert, and how often and for how long the hash map rehashed.
+ *
+ *        Lookups are const on the hash map, so any number of threads may run
+ *        them at once as long as none modifies the map, just as without
+ *        instrumentation. Their histograms are shared_probe_histograms for
+ *        that reason, everything else is only recorded by modifiers.
+ */
+struct map_stats {
+  static constexpr bool enabled = true;
+
+  // adds the time from construction to destruction to the rehash time
+  class rehash_timer {
+  public:
+    explicit rehash_timer(map_stats &stats)
+        : stats_{stats}, start_{std::chrono::steady_clock::now()} {}
+    ~rehash_timer() {
+      stats_.rehash_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start_);
+    }
+
+    rehash_timer(const rehash_timer &) = delete;
+    rehash_timer &operator=(const rehash_timer &) = delete;
+
+  private:
+    map_stats &stats_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  mutable shared_probe_histogram hits;
+  mutable shared_probe_histogram misses;
+  probe_histogram inserts;
+  size_t resizes = 0;
+  std::chrono::nanoseconds rehash_time{0};
+
+  void record_lookup(size_t length, bool hit) const noexcept {
+    (hit ? hits : misses).record(length);
+  }
+  void record_insert(size_t length) noexcept { inserts.record(length); }
+  void record_resize() noexcept { resizes++; }
+  rehash_timer time_rehash() { return rehash_timer(*this); }
+};
+
+}; // namespace nhzaci
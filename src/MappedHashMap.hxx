@@ -0,0 +1,599 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MapNode.hxx"
+#include "Probe.hxx"
+
+namespace nhzaci {
+
+namespace detail {
+
+inline constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+inline constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+// 64-bit FNV-1a over bytes, continuing from hash
+inline uint64_t fnv1a(const void *data, size_t bytes,
+                      uint64_t hash = kFnvOffsetBasis) noexcept {
+  auto p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < bytes; i++) {
+    hash ^= p[i];
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+/**
+ * @brief Checksum of snapshot buckets, FNV-1a over 64-bit words rather than
+ *        bytes, spread over four independent lanes so that the multiplies
+ *        overlap and verifying a snapshot runs close to memory bandwidth
+ */
+inline uint64_t snapshot_checksum(const void *data, size_t bytes) noexcept {
+  auto p = static_cast<const unsigned char *>(data);
+  uint64_t lanes[4] = {kFnvOffsetBasis, kFnvOffsetBasis ^ 1,
+                       kFnvOffsetBasis ^ 2, kFnvOffsetBasis ^ 3};
+
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    for (size_t lane = 0; lane < 4; lane++) {
+      uint64_t word;
+      std::memcpy(&word, p + i + lane * 8, sizeof(word));
+      lanes[lane] = (lanes[lane] ^ word) * kFnvPrime;
+    }
+  }
+
+  auto hash = fnv1a(p + i, bytes - i, lanes[0]);
+  for (size_t lane = 1; lane < 4; lane++)
+    hash = fnv1a(&lanes[lane], sizeof(lanes[lane]), hash);
+  return hash;
+}
+
+}; // namespace detail
+
+/**
+ * @brief Header at the start of every snapshot file, followed directly by
+ *        capacity InlineMapNode buckets. Integers are stored in native byte
+ *        order, snapshots are not meant to move between architectures.
+ */
+struct snapshot_header {
+  static constexpr std::array<char, 8> kMagic = {'N', 'H', 'Z', 'S',
+                                                 'N', 'A', 'P', '\0'};
+  // bumped whenever the layout of the file or the probing over it changes
+  static constexpr uint32_t kVersion = 1;
+
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t node_size;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint64_t capacity;
+  uint64_t size;
+  // snapshot_hash_tag of the hash function the buckets were laid out with
+  uint64_t hash_tag;
+  // snapshot_checksum of the bucket bytes
+  uint64_t checksum;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(snapshot_header) == 64 and
+                  std::is_trivially_copyable_v<snapshot_header>,
+              "snapshot_header must be written without padding");
+
+/**
+ * @brief Fingerprints a hash function by hashing a fixed set of keys, so a
+ *        snapshot is never probed with a different hash function (or seed,
+ *        or standard library) than the one it was laid out with
+ */
+template <typename Key, typename Hash>
+uint64_t snapshot_hash_tag(const Hash &hash_f) {
+  static_assert(std::is_trivially_copyable_v<Key>,
+                "Key of a snapshot must be trivially copyable");
+
+  uint64_t tag = detail::kFnvOffsetBasis;
+  for (size_t i = 0; i < 8; i++) {
+    // bytes of 0 and 1 only, which are valid values of bool and enum keys
+    std::array<unsigned char, sizeof(Key)> bytes;
+    for (size_t b = 0; b < bytes.size(); b++)
+      bytes[b] = (i >> (b % 3)) & 1;
+
+    Key key;
+    std::memcpy(static_cast<void *>(&key), bytes.data(), sizeof(Key));
+    size_t hash = hash_f(key);
+    tag = detail::fnv1a(&hash, sizeof(hash), tag);
+  }
+  return tag;
+}
+
+/**
+ * @brief How mapped_hash_map maps a snapshot, copy_on_write lets values be
+ *        modified in memory, touching only private copies of the pages and
+ *        never the file
+ */
+enum class snapshot_access { read_only, copy_on_write };
+
+/**
+ * @brief Read only hash map serving lookups straight out of a snapshot file
+ *        written by save(), mapped with mmap. Opening
+ *        it costs no inserts, no allocations and no rehashing, pages are only
+ *        read in as lookups touch them.
+ *
+ *        Snapshots store InlineMapNode buckets laid out with linear probing
+ *        over fibonacci_index, whatever node layout and probe the saved map
+ *        used.
+ *
+ * @tparam Key        Type of key objects, must be trivially copyable
+ * @tparam T          Type of mapped objects, must be trivially copyable
+ * @tparam Hash       Hashing function object type, must match the hash map
+ * the snapshot was saved from
+ * @tparam KeyEqual   Predicate function object type, defaults to
+ * std::equal_to<Key>
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>>
+class mapped_hash_map {
+  static_assert(std::is_trivially_copyable_v<Key> and
+                    std::is_trivially_copyable_v<T>,
+                "Key and T of a snapshot must be trivially copyable");
+
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = InlineMapNode<Key, T>;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using prober = probe<Key, value_type, Hash, KeyEqual, fibonacci_index>;
+
+  static_assert(alignof(value_type) <= alignof(snapshot_header),
+                "buckets must stay aligned after the snapshot header");
+
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = const InlineMapNode<Key, T>;
+    using pointer = value_type *;
+    using reference = value_type &;
+
+    Iterator(pointer ptr, pointer end) : m_ptr{ptr}, m_end{end} {
+      skip_empty_buckets();
+    }
+
+    reference operator*() const { return *m_ptr; }
+    pointer operator->() const { return m_ptr; }
+
+    Iterator &operator++() {
+      m_ptr++;
+      skip_empty_buckets();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+
+    friend bool operator==(const Iterator &a, const Iterator &b) {
+      return a.m_ptr == b.m_ptr;
+    };
+    friend bool operator!=(const Iterator &a, const Iterator &b) {
+      return a.m_ptr != b.m_ptr;
+    };
+
+  private:
+    pointer m_ptr;
+    pointer m_end;
+
+    void skip_empty_buckets() {
+      while (m_ptr != m_end and not m_ptr->occupied())
+        m_ptr++;
+    }
+  };
+
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  const_iterator begin() const {
+    return Iterator(container_p_, container_p_ + max_size_);
+  }
+  const_iterator end() const { return make_iterator(nullptr); }
+
+  /////////////////////
+  // Special Mem Fns //
+  /////////////////////
+
+  /**
+   * @brief Maps the snapshot at path, checking its header against Key, T and
+   *        the hash function
+   *
+   * @param path        snapshot written by save()
+   * @param access      read_only, or copy_on_write to allow writable_at() to
+   * modify values in memory
+   * @param verify      also checks the checksum, which reads the whole file
+   * in, pass false to only fault in the pages lookups touch. The header is
+   * checked either way, and lookups into corrupt buckets still terminate.
+   * @throws std::system_error   if the file cannot be opened or mapped
+   * @throws std::runtime_error  if the file is not a snapshot of this map
+   */
+  explicit mapped_hash_map(const std::string &path,
+                           snapshot_access access = snapshot_access::read_only,
+                           bool verify = true, const hasher &hash_f = hasher(),
+                           const key_equal &equal_to_f = key_equal())
+      : access_{access}, hash_fn_{hash_f}, key_eq_fn_{equal_to_f} {
+    map_file(path);
+    try {
+      check_header(path, verify);
+    } catch (...) {
+      unmap_file();
+      throw;
+    }
+  }
+  ~mapped_hash_map() { unmap_file(); }
+
+  // deleted as copying would unmap the pages twice
+  mapped_hash_map(const mapped_hash_map &) = delete;
+  mapped_hash_map &operator=(const mapped_hash_map &) = delete;
+
+  mapped_hash_map(mapped_hash_map &&other) noexcept
+      : mapping_{std::exchange(other.mapping_, nullptr)},
+        mapping_bytes_{std::exchange(other.mapping_bytes_, 0)},
+        container_p_{std::exchange(other.container_p_, nullptr)},
+        max_size_{std::exchange(other.max_size_, 0)},
+        curr_size_{std::exchange(other.curr_size_, 0)}, access_{other.access_},
+        hash_fn_{other.hash_fn_}, key_eq_fn_{other.key_eq_fn_} {}
+  mapped_hash_map &operator=(mapped_hash_map &&other) noexcept {
+    if (this != &other) {
+      unmap_file();
+      mapping_ = std::exchange(other.mapping_, nullptr);
+      mapping_bytes_ = std::exchange(other.mapping_bytes_, 0);
+      container_p_ = std::exchange(other.container_p_, nullptr);
+      max_size_ = std::exchange(other.max_size_, 0);
+      curr_size_ = std::exchange(other.curr_size_, 0);
+      access_ = other.access_;
+      hash_fn_ = other.hash_fn_;
+      key_eq_fn_ = other.key_eq_fn_;
+    }
+    return *this;
+  }
+
+  /////////////////////
+  // Capacity  start //
+  /////////////////////
+
+  bool empty() const { return curr_size_ == 0; }
+
+  size_t size() const { return curr_size_; }
+
+  size_t max_size() const { return max_size_; }
+
+  /////////////////////
+  // Capacity  end   //
+  /////////////////////
+
+  /////////////////////
+  // Lookup start    //
+  /////////////////////
+
+  const T &at(const key_type &key) const {
+    auto node = find_node(key);
+
+    if (node == nullptr) {
+      throw std::out_of_range("Key not found in hash map");
+    }
+
+    return node->value();
+  }
+
+  /**
+   * @brief at() for writing, only copy_on_write mappings may be written to
+   *
+   * @throws std::logic_error   if the snapshot is mapped read_only
+   */
+  T &writable_at(const key_type &key) {
+    if (access_ != snapshot_access::copy_on_write)
+      throw std::logic_error("Snapshot is mapped read only");
+
+    return const_cast<T &>(at(key));
+  }
+
+  size_type count(const key_type &key) const {
+    if (find_node(key) == nullptr)
+      return 0;
+
+    return 1;
+  }
+
+  const_iterator find(const key_type &key) const {
+    return make_iterator(find_node(key));
+  }
+
+  bool contains(const key_type &key) const { return find_node(key) != nullptr; }
+
+  /////////////////////
+  // Lookup end      //
+  /////////////////////
+
+  ////////////////////////////
+  // Observers        start //
+  ////////////////////////////
+
+  hasher hash_function() const { return hash_fn_; }
+  key_equal key_eq() const { return key_eq_fn_; }
+
+  ////////////////////////////
+  // Observers        end   //
+  ////////////////////////////
+
+  /**
+   * @brief Writes items into a snapshot at path, laid out the way
+   *        mapped_hash_map probes it. The file is written next to path,
+   *        synced and renamed over it, and the directory synced after, so
+   *        readers never map a half written snapshot, even after a crash.
+   *
+   * @param items             range of nodes with key and value(), with
+   * unique keys
+   * @param size              number of items
+   * @param max_load_factor   load factor the buckets are sized for
+   * @throws std::runtime_error  if the file cannot be written
+   */
+  template <typename Items>
+  static void write(const std::string &path, const Items &items,
+                    size_type size, float max_load_factor,
+                    const hasher &hash_f = hasher(),
+                    const key_equal &equal_to_f = key_equal()) {
+    // at least one empty bucket, so probing for a missing key ends
+    auto capacity = std::bit_ceil(std::max(
+        size + 1, static_cast<size_type>(std::ceil(size / max_load_factor))));
+
+    // zeroed so that padding and empty buckets are written deterministically
+    std::vector<value_type> buckets(capacity);
+    std::memset(static_cast<void *>(buckets.data()), 0,
+                capacity * sizeof(value_type));
+
+    prober probe_f;
+    for (const auto &item : items) {
+      auto index = probe_f.get_empty_bucket_index(buckets.data(), capacity,
+                                                  item.key, hash_f, equal_to_f);
+      buckets[index].key = item.key;
+      buckets[index].t = item.value();
+      buckets[index].is_occupied = true;
+    }
+
+    snapshot_header header{};
+    header.magic = snapshot_header::kMagic;
+    header.version = snapshot_header::kVersion;
+    header.node_size = sizeof(value_type);
+    header.key_size = sizeof(Key);
+    header.value_size = sizeof(T);
+    header.capacity = capacity;
+    header.size = size;
+    header.hash_tag = snapshot_hash_tag<Key>(hash_f);
+    header.checksum = detail::snapshot_checksum(buckets.data(),
+                                                capacity * sizeof(value_type));
+
+    // a unique name next to path, so that concurrent saves never write into
+    // each other's file and the rename stays within one filesystem
+    auto tmp = path + ".XXXXXX";
+    int fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category(),
+                              "Failed to create snapshot " + tmp);
+
+    // the data has to reach the disk before the rename does, or a crash can
+    // leave path naming an empty or partial file
+    if (::fchmod(fd, 0644) == -1 or
+        not write_all(fd, &header, sizeof(header)) or
+        not write_all(fd, buckets.data(), capacity * sizeof(value_type)) or
+        ::fsync(fd) == -1) {
+      int err = errno;
+      ::close(fd);
+      ::unlink(tmp.c_str());
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to write snapshot " + tmp);
+    }
+    if (::close(fd) == -1) {
+      int err = errno;
+      ::unlink(tmp.c_str());
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to write snapshot " + tmp);
+    }
+
+    if (::rename(tmp.c_str(), path.c_str()) == -1) {
+      int err = errno;
+      ::unlink(tmp.c_str());
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to rename snapshot to " + path);
+    }
+    sync_directory_of(path);
+  }
+
+private:
+  void *mapping_ = nullptr;
+  size_type mapping_bytes_ = 0;
+  value_type *container_p_ = nullptr;
+  size_type max_size_ = 0;
+  size_type curr_size_ = 0;
+  snapshot_access access_;
+  hasher hash_fn_;
+  key_equal key_eq_fn_;
+
+  // writes bytes in full, retrying short and interrupted writes
+  static bool write_all(int fd, const void *data, size_t bytes) noexcept {
+    auto p = static_cast<const char *>(data);
+    while (bytes > 0) {
+      auto written = ::write(fd, p, bytes);
+      if (written == -1 and errno == EINTR)
+        continue;
+      if (written == -1)
+        return false;
+      p += written;
+      bytes -= static_cast<size_t>(written);
+    }
+    return true;
+  }
+
+  // makes the rename of path durable, it lives in the directory entry
+  static void sync_directory_of(const std::string &path) {
+    auto dir = std::filesystem::path(path).parent_path();
+    if (dir.empty())
+      dir = ".";
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category(),
+                              "Failed to open directory of snapshot " + path);
+    int err = ::fsync(fd) == -1 ? errno : 0;
+    ::close(fd);
+    if (err != 0)
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to sync directory of snapshot " + path);
+  }
+
+  // maps the whole file privately, the descriptor is not needed afterwards
+  void map_file(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category(),
+                              "Failed to open snapshot " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to stat snapshot " + path);
+    }
+
+    mapping_bytes_ = static_cast<size_type>(st.st_size);
+    if (mapping_bytes_ < sizeof(snapshot_header)) {
+      ::close(fd);
+      throw std::runtime_error("Snapshot is truncated: " + path);
+    }
+
+    int prot = PROT_READ;
+    if (access_ == snapshot_access::copy_on_write)
+      prot |= PROT_WRITE;
+    void *mapping = ::mmap(nullptr, mapping_bytes_, prot, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+      throw std::system_error(err, std::generic_category(),
+                              "Failed to map snapshot " + path);
+    mapping_ = mapping;
+  }
+
+  void unmap_file() noexcept {
+    if (mapping_ != nullptr)
+      ::munmap(mapping_, mapping_bytes_);
+    mapping_ = nullptr;
+    mapping_bytes_ = 0;
+    container_p_ = nullptr;
+    max_size_ = 0;
+    curr_size_ = 0;
+  }
+
+  void check_header(const std::string &path, bool verify) {
+    snapshot_header header;
+    std::memcpy(&header, mapping_, sizeof(header));
+
+    if (header.magic != snapshot_header::kMagic)
+      throw std::runtime_error("Not a snapshot: " + path);
+    if (header.version != snapshot_header::kVersion)
+      throw std::runtime_error("Unsupported snapshot version: " + path);
+    if (header.node_size != sizeof(value_type) or
+        header.key_size != sizeof(Key) or header.value_size != sizeof(T))
+      throw std::runtime_error("Snapshot holds different types: " + path);
+    if (header.hash_tag != snapshot_hash_tag<Key>(hash_fn_))
+      throw std::runtime_error("Snapshot uses a different hash function: " +
+                               path);
+    // compared by division, a corrupt capacity may overflow the multiply
+    auto bucket_bytes = mapping_bytes_ - sizeof(snapshot_header);
+    if (not std::has_single_bit(header.capacity) or
+        header.size >= header.capacity or
+        bucket_bytes % sizeof(value_type) != 0 or
+        bucket_bytes / sizeof(value_type) != header.capacity)
+      throw std::runtime_error("Snapshot is truncated or corrupt: " + path);
+
+    auto buckets = static_cast<std::byte *>(mapping_) + sizeof(header);
+    if (verify and detail::snapshot_checksum(
+                       buckets, header.capacity * sizeof(value_type)) !=
+                       header.checksum)
+      throw std::runtime_error("Snapshot checksum mismatch: " + path);
+
+    container_p_ = reinterpret_cast<value_type *>(buckets);
+    max_size_ = header.capacity;
+    curr_size_ = header.size;
+  }
+
+  // probes the way prober does, but gives up after visiting every bucket,
+  // as a corrupt snapshot that was not verified may have no empty bucket
+  const value_type *find_node(const key_type &key) const {
+    auto mask = max_size_ - 1;
+    auto bucket = fibonacci_index{}(hash_fn_(key), max_size_);
+
+    for (size_type probed = 0; probed < max_size_; probed++) {
+      if (not container_p_[bucket].occupied())
+        return nullptr;
+      if (key_eq_fn_(key, container_p_[bucket].key))
+        return container_p_ + bucket;
+      bucket = (bucket + 1) & mask;
+    }
+    return nullptr;
+  }
+
+  // iterator at node, or end() if node is null
+  Iterator make_iterator(const value_type *node) const {
+    auto end = container_p_ + max_size_;
+    return Iterator(node == nullptr ? end : node, end);
+  }
+};
+
+/**
+ * @brief Saves every item of map to a snapshot file at path, which
+ *        mapped_hash_map<Key, T, Hash, KeyEqual> can then map and serve
+ *        lookups from without rebuilding the map. Items are laid out afresh
+ *        in flat InlineMapNode buckets sized for max_load_factor(), whatever
+ *        node layout and probe map uses.
+ *
+ *        A free function so that hash maps themselves never depend on mmap
+ *        and the POSIX headers.
+ *
+ * @param map     open_addressed_hash_map, or inline_hash_map, to save
+ * @param path    file to write, replaced if it exists
+ * @throws std::runtime_error  if the file cannot be written
+ */
+template <typename Map>
+  requires(std::is_trivially_copyable_v<typename Map::key_type> and
+           std::is_trivially_copyable_v<typename Map::mapped_type>)
+void save(const Map &map, const std::string &path) {
+  mapped_hash_map<typename Map::key_type, typename Map::mapped_type,
+                  typename Map::hasher,
+                  typename Map::key_equal>::write(path, map, map.size(),
+                                                  map.max_load_factor(),
+                                                  map.hash_function(),
+                                                  map.key_eq());
+}
+
+}; // namespace nhzaci
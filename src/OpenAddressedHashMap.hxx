@@ -1,15 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <cstddef>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <span>
+#include <stdexcept>
 #include <utility>
 
 #include "MapNode.hxx"
+#include "MapStats.hxx"
 #include "Probe.hxx"
+#include "ValuePool.hxx"
 
 namespace nhzaci {
 
@@ -19,28 +27,49 @@ namespace nhzaci {
  *
  * @tparam Key        Type of key objects
  * @tparam T          Type of mapped objects
- * @tparam Hash       Hashing function object type, defaults to std::hash<T>
+ * @tparam Hash       Hashing function object type, defaults to std::hash<Key>
  * @tparam KeyEqual   Predicate function object type, defaults to
  * std::equal_to<Key>
- * @tparam Allocator  defaults to std::allocator<MapNode<const Key, T>>
+ * @tparam Allocator  defaults to std::allocator<MapNode<const Key, T>>, its
+ * value_type picks the node layout: MapNode owns a heap allocated value,
+ * InlineMapNode stores the value in the bucket and PooledMapNode points into a
+ * value_pool drawing slabs from the allocator
  * @tparam Probe      Probe algorithm function object type, defaults to probe<T>
- * which linearly probes
+ * which linearly probes, group_probe from GroupProbe.hxx probes with SIMD over
+ * a separate control byte array, robin_hood_probe from RobinHoodProbe.hxx
+ * orders clusters by probe distance. Capacity is always a power of two.
+ * @tparam Stats      Instrumentation policy, defaults to no_map_stats which
+ * records nothing, map_stats from MapStats.hxx records probe lengths and
+ * rehashes for stats()
  */
-template <typename Key, typename T, typename Hash = std::hash<T>,
+template <typename Key, typename T, typename Hash = std::hash<Key>,
           typename KeyEqual = std::equal_to<Key>,
           typename Allocator = std::allocator<MapNode<Key, T>>,
-          typename Probe = probe<Key, MapNode<Key, T>, Hash, KeyEqual>>
+          typename Probe = probe<Key, MapNode<Key, T>, Hash, KeyEqual>,
+          typename Stats = no_map_stats>
 class open_addressed_hash_map {
 public:
   class Iterator {
   public:
     using iterator_category = std::forward_iterator_tag;
     using difference_type = std::ptrdiff_t;
-    using value_type = MapNode<Key, T>;
+    using value_type = typename std::allocator_traits<Allocator>::value_type;
     using pointer = value_type *;
     using reference = value_type &;
 
-    Iterator(pointer ptr) : m_ptr{ptr} {};
+    /**
+     * @brief Iterates over the occupied buckets from ptr up to end, jumping
+     *        over [gap, gap_end), then carries on from next to next_end. The
+     *        first range covers the old container while an incremental
+     *        rehash is in progress, and the gap its buckets already migrated.
+     */
+    Iterator(pointer ptr, pointer end, pointer gap = nullptr,
+             pointer gap_end = nullptr, pointer next = nullptr,
+             pointer next_end = nullptr)
+        : m_ptr{ptr}, m_end{end}, m_gap{gap}, m_gap_end{gap_end},
+          m_next{next}, m_next_end{next_end} {
+      skip_empty_buckets();
+    };
 
     reference operator*() const { return *m_ptr; }
     pointer operator->() { return m_ptr; }
@@ -48,10 +77,11 @@ public:
     // Prefix increment
     Iterator &operator++() {
       m_ptr++;
+      skip_empty_buckets();
       return *this;
     }
     // Postfix increment
-    Iterator &operator++(int) {
+    Iterator operator++(int) {
       Iterator tmp = *this;
       ++(*this);
       return tmp;
@@ -67,12 +97,36 @@ public:
 
   private:
     pointer m_ptr;
+    pointer m_end;
+    pointer m_gap;
+    pointer m_gap_end;
+    pointer m_next;
+    pointer m_next_end;
+
+    void skip_empty_buckets() {
+      while (true) {
+        while (m_ptr != m_end) {
+          if (m_ptr == m_gap)
+            m_ptr = m_gap_end;
+          else if (m_ptr->occupied())
+            break;
+          else
+            m_ptr++;
+        }
+        if (m_ptr != m_end or m_next == nullptr)
+          return;
+        m_ptr = m_next;
+        m_end = m_next_end;
+        m_gap = nullptr;
+        m_next = nullptr;
+      }
+    }
   };
 
   // member types as required on cppreference
   using key_type = Key;
   using mapped_type = T;
-  using value_type = MapNode<Key, T>;
+  using value_type = typename std::allocator_traits<Allocator>::value_type;
   using size_type = size_t;
   using difference_type = std::ptrdiff_t;
   using hasher = Hash;
@@ -87,47 +141,101 @@ public:
   using const_iterator = const Iterator;
   using prober = Probe;
 
-  iterator begin() { return Iterator(container_p_); }
-  iterator end() { return Iterator(container_p_ + max_size_); }
+  static_assert(std::is_same_v<typename prober::value_type_p, value_type *>,
+                "Probe must probe over the node type of Allocator");
+
+  iterator begin() { return make_begin(); }
+  iterator end() { return make_iterator(nullptr); }
 
-  const_iterator begin() const { return Iterator(container_p_); }
-  const_iterator end() const { return Iterator(container_p_ + max_size_); }
+  const_iterator begin() const { return make_begin(); }
+  const_iterator end() const { return make_iterator(nullptr); }
 
   /////////////////////
   // Special Mem Fns //
   /////////////////////
 
-  open_addressed_hash_map()
+  open_addressed_hash_map() : open_addressed_hash_map(allocator_type()) {}
+
+  // buckets, and pooled values for large mapped types, all come from alloc
+  explicit open_addressed_hash_map(const allocator_type &alloc)
       : container_p_{nullptr}, max_size_{0}, curr_size_{0},
         max_load_factor_{0.75}, hash_fn_{hasher()}, probe_fn_{prober()},
-        key_eq_fn_{key_equal()}, alloc_{} {};
-  ~open_addressed_hash_map() {
-    if (container_p_ != nullptr) {
-      // TODO: Deallocate from alloc instead of delete
-      // traits_t::deallocate(alloc_, container_p_, max_size_);
-      delete[] container_p_;
-    }
-  }
+        key_eq_fn_{key_equal()}, alloc_{alloc}, value_pool_{alloc_} {};
+  ~open_addressed_hash_map() { clear(); }
 
   // deleted as copying could lead to double-free
   open_addressed_hash_map(const open_addressed_hash_map &) = delete;
   open_addressed_hash_map &operator=(const open_addressed_hash_map &) = delete;
 
   // moving is fine though!
-  open_addressed_hash_map(open_addressed_hash_map &&other) {
+  open_addressed_hash_map(open_addressed_hash_map &&other)
+      : alloc_{other.alloc_}, value_pool_{std::move(other.value_pool_)} {
     container_p_ = other.container_p_;
     max_size_ = other.max_size_;
     curr_size_ = other.curr_size_;
-    max_load_factor_ = 0.75;
+    max_load_factor_ = other.max_load_factor_;
     hash_fn_ = other.hash_fn_;
-    alloc_ = other.alloc_;
+    key_eq_fn_ = other.key_eq_fn_;
+    // stateful probes own metadata describing container_p_
+    probe_fn_ = std::move(other.probe_fn_);
+    old_container_p_ = other.old_container_p_;
+    old_max_size_ = other.old_max_size_;
+    old_size_ = other.old_size_;
+    migrate_start_ = other.migrate_start_;
+    migrate_index_ = other.migrate_index_;
+    old_probe_fn_ = std::move(other.old_probe_fn_);
+    next_container_p_ = other.next_container_p_;
+    next_max_size_ = other.next_max_size_;
+    next_init_index_ = other.next_init_index_;
+    next_probe_fn_ = std::move(other.next_probe_fn_);
+    incremental_rehash_ = other.incremental_rehash_;
+    stats_ = other.stats_;
 
     other.container_p_ = nullptr;
     other.curr_size_ = 0;
     other.max_size_ = 0;
+    other.old_container_p_ = nullptr;
+    other.old_max_size_ = 0;
+    other.old_size_ = 0;
+    other.next_container_p_ = nullptr;
+    other.next_max_size_ = 0;
+    other.next_init_index_ = 0;
   }
   open_addressed_hash_map &operator=(open_addressed_hash_map &&other) {
-    this(std::move(other));
+    if (this != &other) {
+      clear();
+      container_p_ = other.container_p_;
+      max_size_ = other.max_size_;
+      curr_size_ = other.curr_size_;
+      max_load_factor_ = other.max_load_factor_;
+      hash_fn_ = other.hash_fn_;
+      key_eq_fn_ = other.key_eq_fn_;
+      probe_fn_ = std::move(other.probe_fn_);
+      alloc_ = other.alloc_;
+      value_pool_ = std::move(other.value_pool_);
+      old_container_p_ = other.old_container_p_;
+      old_max_size_ = other.old_max_size_;
+      old_size_ = other.old_size_;
+      migrate_start_ = other.migrate_start_;
+      migrate_index_ = other.migrate_index_;
+      old_probe_fn_ = std::move(other.old_probe_fn_);
+      next_container_p_ = other.next_container_p_;
+      next_max_size_ = other.next_max_size_;
+      next_init_index_ = other.next_init_index_;
+      next_probe_fn_ = std::move(other.next_probe_fn_);
+      incremental_rehash_ = other.incremental_rehash_;
+      stats_ = other.stats_;
+
+      other.container_p_ = nullptr;
+      other.curr_size_ = 0;
+      other.max_size_ = 0;
+      other.old_container_p_ = nullptr;
+      other.old_max_size_ = 0;
+      other.old_size_ = 0;
+      other.next_container_p_ = nullptr;
+      other.next_max_size_ = 0;
+      other.next_init_index_ = 0;
+    }
     return *this;
   }
 
@@ -135,11 +243,11 @@ public:
   // Capacity  start //
   /////////////////////
 
-  bool empty() { return curr_size_ == 0; }
+  bool empty() const { return curr_size_ == 0; }
 
-  size_t size() { return curr_size_; }
+  size_t size() const { return curr_size_; }
 
-  size_t max_size() { return max_size_; }
+  size_t max_size() const { return max_size_; }
 
   /////////////////////
   // Capacity  end   //
@@ -149,21 +257,40 @@ public:
   // Modifiers start //
   /////////////////////
 
-  // TODO: Deallocate with alloc
   void clear() {
     if (container_p_ == nullptr)
       return;
 
-    // traits_t::deallocate(alloc_, container_p_, max_size_);
-    delete[] container_p_;
+    discard_next_container();
+
+    if (old_container_p_ != nullptr) {
+      // migrated buckets are destroyed already
+      for (size_t i = 0; i < old_max_size_; i++) {
+        if (is_migrated(i))
+          continue;
+        if (old_container_p_[i].occupied())
+          release_node(old_container_p_[i]);
+        traits_t::destroy(alloc_, old_container_p_ + i);
+      }
+      finish_incremental_rehash();
+    }
+
+    for (size_t i = 0; i < max_size_; i++) {
+      if (container_p_[i].occupied())
+        release_node(container_p_[i]);
+    }
+
+    deallocate_container(container_p_, max_size_);
+    value_pool_.release();
+    probe_fn_.clear();
     container_p_ = nullptr;
     curr_size_ = 0;
     max_size_ = 0;
   }
 
-  // TODO: Deallocate with alloc
   std::pair<iterator, bool> insert(const value_type &value) {
     expand_container_if_load_factor_reached();
+    advance_incremental_rehash(value.key);
     auto idx = get_empty_bucket_index(value.key);
 
     // TODO: I don't really like this additional embedded null check in
@@ -173,33 +300,42 @@ public:
     // key which becomes a problem since the other key values will live on
     // forever in the hash map but never get retrieved...
     //
-    // avoid memory leak, if the existing pointer is not empty, we should free
-    // it first before replacing it and leaving a dangling pointer
-    if (container_p_[idx].t_p != nullptr) {
-      delete container_p_[idx].t_p;
+    // avoid memory leak, if the existing bucket is not empty, we should free
+    // its value first before replacing it and leaving a dangling pointer
+    if (container_p_[idx].occupied()) {
+      release_node(container_p_[idx]);
       curr_size_--;
     }
 
-    container_p_[idx] = value;
+    if constexpr (value_type::storage == node_storage::pooled)
+      container_p_[idx] =
+          value_type(value.key, value_pool_.create(*value.t_p));
+    else
+      container_p_[idx] = value;
     curr_size_++;
-    return {Iterator(&(container_p_[idx])), true};
+    return {make_iterator(&(container_p_[idx])), true};
   }
 
-  // TODO: Deallocate with alloc
   std::pair<iterator, bool> insert(value_type &&value) {
     expand_container_if_load_factor_reached();
+    advance_incremental_rehash(value.key);
     auto idx = get_empty_bucket_index(value.key);
 
-    // avoid memory leak, if the existing pointer is not empty, we should free
-    // it first before replacing it and leaving a dangling pointer
-    if (container_p_[idx].t_p != nullptr) {
-      delete container_p_[idx].t_p;
+    // avoid memory leak, if the existing bucket is not empty, we should free
+    // its value first before replacing it and leaving a dangling pointer
+    if (container_p_[idx].occupied()) {
+      release_node(container_p_[idx]);
       curr_size_--;
     }
 
-    container_p_[idx] = move(value);
+    // pooled nodes never own their value, so only the value is moved
+    if constexpr (value_type::storage == node_storage::pooled)
+      container_p_[idx] =
+          value_type(value.key, value_pool_.create(std::move(*value.t_p)));
+    else
+      container_p_[idx] = std::move(value);
     curr_size_++;
-    return {Iterator(&(container_p_[idx])), true};
+    return {make_iterator(&(container_p_[idx])), true};
   }
 
   // template <class M>
@@ -219,10 +355,50 @@ public:
   // template< class... Args >
   // pair<iterator, bool> try_emplace( const Key& k, Args&&... args );
 
-  iterator erase(const_iterator pos);
+  /**
+   * @brief Erases the item at pos, the probe closes the hole it leaves so the
+   *        bucket may now hold an item shifted back from later in its cluster
+   *
+   * @return iterator   iterator to the same bucket, or the next item if
+   *                     the bucket was left empty
+   */
+  iterator erase(const_iterator pos) {
+    auto node = &*pos;
+
+    if (is_in_old_container(node)) {
+      size_type index = node - old_container_p_;
+      erase_old_bucket(index);
+      return make_iterator(old_container_p_ + index);
+    }
+
+    size_type index = node - container_p_;
+    erase_bucket(index);
+    return make_iterator(container_p_ + index);
+  }
   iterator erase(const_iterator first, const_iterator last);
-  size_type erase(const key_type &key);
-  template <typename K> size_type erase(K &&x);
+  size_type erase(const key_type &key) {
+    advance_incremental_rehash();
+    size_type index = find_item_index(key);
+
+    if (index != max_size_) {
+      erase_bucket(index);
+      return 1;
+    }
+
+    if (old_container_p_ != nullptr) {
+      index = find_old_item_index(key);
+      if (index != old_max_size_) {
+        erase_old_bucket(index);
+        return 1;
+      }
+    }
+
+    return 0;
+  }
+  template <typename K> size_type erase(K &&x) {
+    const key_type key(std::forward<K>(x));
+    return erase(key);
+  }
 
   void swap(open_addressed_hash_map &other) noexcept;
 
@@ -235,22 +411,22 @@ public:
   /////////////////////
 
   T &at(const key_type &key) {
-    size_type index = find_item_index(key);
+    auto node = find_node(key);
 
-    if (index == max_size_) {
+    if (node == nullptr) {
       throw std::out_of_range("Key not found in hash map");
     }
 
-    return *container_p_[index].t_p;
+    return node->value();
   }
   const T &at(const key_type &key) const {
-    size_type index = find_item_index(key);
+    auto node = find_node(key);
 
-    if (index == max_size_) {
+    if (node == nullptr) {
       throw std::out_of_range("Key not found in hash map");
     }
 
-    return *container_p_[index].t_p;
+    return node->value();
   }
 
   T &operator[](const key_type &key) { return find_or_default_construct(key); }
@@ -258,29 +434,63 @@ public:
   T &operator[](key_type &&key) { return find_or_default_construct(key); }
 
   size_type count(const key_type &key) const {
-    size_type startIdx = find_item_index(key);
-
-    // if out of bound, item is not found
-    if (startIdx == max_size_)
+    // if no node is found, item is not found
+    if (find_node(key) == nullptr)
       return 0;
 
     return 1;
   }
-  template <typename K> size_type count(const K &x) const { return count(x); }
-
-  iterator find(const key_type &key) {
-    return Iterator(container_p_ + find_item_index(key));
+  // keys of other types (e.g. string literals) are converted to key_type
+  template <typename K> size_type count(const K &x) const {
+    return count(key_type(x));
   }
+
+  iterator find(const key_type &key) { return make_iterator(find_node(key)); }
   const_iterator find(const key_type &key) const {
-    return Iterator(container_p_ + find_item_index(key));
+    return make_iterator(find_node(key));
   }
-  template <typename K> iterator find(const K &x) { return find(x); }
+  template <typename K> iterator find(const K &x) { return find(key_type(x)); }
   template <typename K> const_iterator find(const K &x) const {
-    return find(x);
+    return find(key_type(x));
   }
 
   bool contains(const key_type &key) const { return find(key) != end(); }
-  template <typename K> bool contains(const K &x) const { return contains(x); }
+  template <typename K> bool contains(const K &x) const {
+    return contains(key_type(x));
+  }
+
+  /**
+   * @brief Looks up every key at once, writing find(keys[i]) into out[i].
+   *        Keys are hashed and their home buckets prefetched a chunk at a
+   *        time before any probe starts, so cache misses of different keys
+   *        overlap instead of stalling one after another.
+   *
+   * @param keys  keys to look up
+   * @param out   iterators to write, must be at least as long as keys
+   */
+  void find_batch(std::span<const key_type> keys, std::span<iterator> out) {
+    find_nodes_batch<false>(keys, [&](size_type i, value_type *node) {
+      out[i] = make_iterator(node);
+    });
+  }
+
+  /**
+   * @brief Same as find_batch writing iterators, but writes a pointer to the
+   *        value keys[i] maps to, or nullptr if it is not found. The values
+   *        are prefetched as well, ready to be read.
+   */
+  void find_batch(std::span<const key_type> keys,
+                  std::span<const T *> out) const {
+    find_nodes_batch<true>(keys, [&](size_type i, value_type *node) {
+      out[i] = node == nullptr ? nullptr : &node->value();
+    });
+  }
+
+  void contains_batch(std::span<const key_type> keys,
+                      std::span<bool> out) const {
+    find_nodes_batch<false>(
+        keys, [&](size_type i, value_type *node) { out[i] = node != nullptr; });
+  }
 
   /////////////////////
   // Lookup end      //
@@ -297,9 +507,52 @@ public:
   float max_load_factor() const { return max_load_factor_; }
   void max_load_factor(float ml) { max_load_factor_ = ml; }
 
-  void rehash(size_type count);
+  /**
+   * @brief Sets the number of buckets to the smallest power of two that is
+   *        at least count and keeps size() items within max_load_factor(),
+   *        rehashing every item at once. Finishes any incremental rehash in
+   *        progress first.
+   *
+   * @param count   new minimum number of buckets
+   */
+  void rehash(size_type count) {
+    complete_incremental_rehash();
+
+    auto needed = std::max(
+        count, static_cast<size_type>(std::ceil(curr_size_ / max_load_factor_)));
+    if (needed == 0)
+      return;
+
+    auto newSize = std::max(std::bit_ceil(needed), kInitialBuckets);
+    if (newSize != max_size_)
+      resize_container(newSize);
+  }
+
+  // pre-sizes the map so that count items fit without growing
+  void reserve(size_type count) {
+    rehash(static_cast<size_type>(std::ceil(count / max_load_factor_)));
+  }
 
-  void reserve(size_type count);
+  /**
+   * @brief Opts in to incremental rehashing. Growing then allocates the new
+   *        container without initializing it, and every insert and erase
+   *        initializes a bounded number of its buckets. Once it is ready the
+   *        old container is kept around, and every insert and erase moves a
+   *        bounded number of its buckets into the new one, so the worst case
+   *        insert no longer depends on the size of the map. Lookups check both
+   *        containers until the old one is drained, and never move buckets
+   *        themselves so references they return stay valid.
+   *
+   * @param enabled   false finishes any incremental rehash in progress
+   */
+  void incremental_rehash(bool enabled) {
+    if (not enabled)
+      complete_incremental_rehash();
+    incremental_rehash_ = enabled;
+  }
+  bool incremental_rehash() const { return incremental_rehash_; }
+
+  bool is_rehashing() const { return old_container_p_ != nullptr; }
 
   ////////////////////////////
   // Hash Policy      end   //
@@ -311,11 +564,87 @@ public:
 
   hasher hash_function() const { return hash_fn_; }
   key_equal key_eq() const { return key_eq_fn_; }
+  allocator_type get_allocator() const { return alloc_; }
 
   ////////////////////////////
   // Observers        end   //
   ////////////////////////////
 
+  ////////////////////////////
+  // Instrumentation  start //
+  ////////////////////////////
+
+  /**
+   * @brief Snapshot of the probe lengths and rehashes recorded so far along
+   *        with the current memory footprint, needs an enabled Stats policy
+   *        such as map_stats
+   */
+  map_stats_snapshot stats() const
+    requires(Stats::enabled)
+  {
+    map_stats_snapshot snapshot;
+    snapshot.hits = stats_.hits.load();
+    snapshot.misses = stats_.misses.load();
+    snapshot.inserts = stats_.inserts;
+    snapshot.longest_probe =
+        std::max({snapshot.hits.longest, snapshot.misses.longest,
+                  snapshot.inserts.longest});
+    snapshot.resizes = stats_.resizes;
+    snapshot.rehash_time = stats_.rehash_time;
+
+    snapshot.size = curr_size_;
+    snapshot.bucket_count = max_size_;
+    snapshot.slot_bytes =
+        (max_size_ + old_max_size_ + next_max_size_) * sizeof(value_type);
+    if constexpr (value_type::storage == node_storage::pooled)
+      snapshot.value_bytes = value_pool_.bytes();
+    else if constexpr (value_type::storage == node_storage::heap)
+      snapshot.value_bytes = curr_size_ * sizeof(T);
+    return snapshot;
+  }
+
+  void reset_stats()
+    requires(Stats::enabled)
+  {
+    stats_ = Stats();
+  }
+
+  /**
+   * @brief Walks the current container once, measuring every run of occupied
+   *        buckets. Costs a pass over all buckets, but works with any Stats
+   *        policy.
+   */
+  cluster_distribution scan_clusters() const {
+    cluster_distribution clusters;
+    if (max_size_ == 0)
+      return clusters;
+
+    // start right after an empty bucket so no cluster is split by wrapping
+    size_type start = 0;
+    while (start < max_size_ and container_p_[start].occupied())
+      start++;
+    if (start == max_size_) {
+      clusters.record(max_size_);
+      return clusters;
+    }
+
+    size_type run = 0;
+    for (size_type i = 1; i <= max_size_; i++) {
+      if (container_p_[(start + i) & (max_size_ - 1)].occupied()) {
+        run++;
+      } else if (run != 0) {
+        clusters.record(run);
+        run = 0;
+      }
+    }
+
+    return clusters;
+  }
+
+  ////////////////////////////
+  // Instrumentation  end   //
+  ////////////////////////////
+
 private:
   value_type *container_p_;
   size_type max_size_;
@@ -325,64 +654,482 @@ private:
   hasher hash_fn_;
   prober probe_fn_;
   allocator_type alloc_;
+  // only pooled nodes need a pool, the others own their values
+  std::conditional_t<value_type::storage == node_storage::pooled,
+                     value_pool<T, allocator_type>, no_value_pool>
+      value_pool_;
+
+  // container being drained by an incremental rehash, with its own probe as
+  // stateful probes describe a single container
+  value_type *old_container_p_ = nullptr;
+  size_type old_max_size_ = 0;
+  size_type old_size_ = 0;
+  // migration visits buckets downwards from migrate_start_, an empty bucket
+  size_type migrate_start_ = 0;
+  size_type migrate_index_ = 0;
+  prober old_probe_fn_;
+  // container allocated for the next incremental rehash, whose first
+  // next_init_index_ buckets have been initialized so far
+  value_type *next_container_p_ = nullptr;
+  size_type next_max_size_ = 0;
+  size_type next_init_index_ = 0;
+  prober next_probe_fn_;
+  bool incremental_rehash_ = false;
+
+  [[no_unique_address]] Stats stats_;
+
+  // TODO: Benchmark and test what's a good starting number to have
+  // for number of buckets
+  static constexpr size_type kInitialBuckets = 4;
+
+  // buckets of the old container visited per insert or erase, which drains
+  // it long before the new container fills for any max_load_factor over 1/6
+  static constexpr size_type kMigrateBucketsPerOp = 8;
+
+  // buckets of the next container initialized per insert or erase, enough
+  // to finish long before the current container is out of free buckets
+  static constexpr size_type kInitBucketsPerOp = 64;
 
-  // TODO: Use the allocator instead of allocating with new
   void expand_container_if_load_factor_reached() {
-    // TODO: Benchmark and test what's a good starting number to have
-    // for number of buckets
     if (max_size_ == 0) {
-      max_size_ = 4;
-      // TODO: Use the allocator instead of allocating with new
-      container_p_ = new value_type[max_size_];
-      // container_p_ = traits_t::allocate(alloc_, max_size_);
-      // traits_t::construct(alloc_, container_p_, max_size_);
+      max_size_ = kInitialBuckets;
+      container_p_ = allocate_container(max_size_);
+      probe_fn_.resize(max_size_);
       return;
     }
 
-    if (static_cast<float>(curr_size_ + 1) / max_size_ <= max_load_factor_)
+    // deleted buckets left by probes that keep tombstones lengthen probes
+    // just like live items, so they count towards the load factor
+    auto used = curr_size_ + probe_fn_.deleted() + 1;
+    if (static_cast<float>(used) / max_size_ <= max_load_factor_)
       return;
 
-    auto newSize = max_size_ * 2;
-    // auto newContainer = traits_t::allocate(alloc_, newSize);
-    auto newContainer = new value_type[newSize];
+    // mostly tombstones, rebuilding at the same size drops them without
+    // growing a table that churn keeps at a steady size
+    auto live = static_cast<float>(curr_size_ + 1) / max_size_;
+    auto newSize = live <= max_load_factor_ / 2 ? max_size_ : max_size_ * 2;
+    if (not incremental_rehash_) {
+      resize_container(newSize);
+      return;
+    }
+
+    // the current container keeps taking inserts while the next one is
+    // initialized, unless it is about to run out of free buckets
+    if (next_container_p_ == nullptr)
+      prepare_incremental_rehash(newSize);
+    else if (static_cast<float>(used) / max_size_ > (max_load_factor_ + 1) / 2)
+      initialize_buckets(std::numeric_limits<size_type>::max());
+  }
+
+  void resize_container(size_type newSize) {
+    stats_.record_resize();
+    [[maybe_unused]] auto timer = stats_.time_rehash();
+    auto newContainer = allocate_container(newSize);
+    probe_fn_.resize(newSize);
     rehash_into_new_container(container_p_, max_size_, newContainer, newSize);
-    delete[] container_p_;
-    // traits_t::deallocate(container_p_, max_size_);
+    if (container_p_ != nullptr)
+      deallocate_container(container_p_, max_size_);
 
     container_p_ = newContainer;
     max_size_ = newSize;
   }
 
+  ////////////////////////////
+  // Incremental rehash     //
+  ////////////////////////////
+
+  /**
+   * @brief Allocates the next container without initializing its buckets,
+   *        which later inserts and erases do a chunk at a time, so that the
+   *        insert growing the map never touches the whole new container
+   */
+  void prepare_incremental_rehash(size_type newSize) {
+    next_container_p_ = traits_t::allocate(alloc_, newSize);
+    next_max_size_ = newSize;
+    next_init_index_ = 0;
+    next_probe_fn_.allocate(newSize);
+  }
+
+  // initializes up to count more buckets of the next container, swapping it
+  // in once every bucket is ready
+  void initialize_buckets(size_type count) {
+    if (next_container_p_ == nullptr)
+      return;
+
+    {
+      [[maybe_unused]] auto timer = stats_.time_rehash();
+      auto last = next_init_index_ +
+                  std::min(count, next_max_size_ - next_init_index_);
+      construct_buckets(next_container_p_, next_init_index_, last);
+      next_probe_fn_.initialize(next_max_size_, next_init_index_, last);
+      next_init_index_ = last;
+    }
+
+    if (next_init_index_ == next_max_size_)
+      start_incremental_rehash();
+  }
+
+  // drops a next container that has not been swapped in yet
+  void discard_next_container() {
+    if (next_container_p_ == nullptr)
+      return;
+
+    deallocate_container(next_container_p_, next_max_size_, next_init_index_);
+    next_probe_fn_.clear();
+    next_container_p_ = nullptr;
+    next_max_size_ = 0;
+    next_init_index_ = 0;
+  }
+
+  // retires the current container for the fully initialized next one, the
+  // items of the current one move over on later inserts
+  void start_incremental_rehash() {
+    migrate_buckets(std::numeric_limits<size_type>::max());
+    stats_.record_resize();
+
+    old_container_p_ = container_p_;
+    old_max_size_ = max_size_;
+    old_size_ = curr_size_;
+    old_probe_fn_ = std::move(probe_fn_);
+    // migrate_buckets looks for an empty bucket down from the last one
+    migrate_start_ = max_size_ - 1;
+    migrate_index_ = 0;
+
+    container_p_ = std::exchange(next_container_p_, nullptr);
+    max_size_ = std::exchange(next_max_size_, 0);
+    next_init_index_ = 0;
+    probe_fn_ = std::move(next_probe_fn_);
+  }
+
+  /**
+   * @brief Visits count buckets of the old container, moving items it finds
+   *        into the current one and destroying every bucket visited, so no
+   *        insert or erase does more than a bounded amount of work.
+   *
+   *        Buckets are visited downwards from an empty bucket, found first,
+   *        so a cluster leaves the old container from its tail and may stop
+   *        anywhere in between. The items left behind sit before every
+   *        released bucket of their cluster, so probes for them never cross
+   *        one, and the released buckets are simply dropped instead of
+   *        shifting the rest of the cluster back for every item.
+   */
+  void migrate_buckets(size_type count) {
+    if (old_container_p_ == nullptr)
+      return;
+
+    [[maybe_unused]] auto timer = stats_.time_rehash();
+    auto mask = old_max_size_ - 1;
+    for (; count > 0; count--) {
+      if (migrate_index_ == 0 and old_container_p_[migrate_start_].occupied()) {
+        migrate_start_ = (migrate_start_ - 1) & mask;
+        continue;
+      }
+
+      auto index = (migrate_start_ - migrate_index_) & mask;
+      if (old_container_p_[index].occupied())
+        migrate_bucket(index);
+      old_probe_fn_.release_bucket(old_container_p_, old_max_size_, index);
+      traits_t::destroy(alloc_, old_container_p_ + index);
+
+      if (++migrate_index_ == old_max_size_) {
+        finish_incremental_rehash();
+        return;
+      }
+    }
+  }
+
+  // whether migrate_buckets has visited, and destroyed, index of the old
+  // container
+  bool is_migrated(size_type index) const {
+    return ((migrate_start_ - index) & (old_max_size_ - 1)) < migrate_index_;
+  }
+
+  // moves the item at index of the old container into the current one,
+  // leaving the caller to release or erase its old bucket
+  void migrate_bucket(size_type index) {
+    auto &node = old_container_p_[index];
+    auto newIndex = probe_fn_.get_empty_bucket_index(
+        container_p_, max_size_, node.key, hash_fn_, key_eq_fn_);
+    container_p_[newIndex] = std::move(node);
+    node.reset();
+    old_size_--;
+  }
+
+  void advance_incremental_rehash() {
+    if (next_container_p_ != nullptr)
+      initialize_buckets(kInitBucketsPerOp);
+    if (old_container_p_ != nullptr)
+      migrate_buckets(kMigrateBucketsPerOp);
+  }
+
+  // also moves key over if it is still in the old container, so that
+  // inserting it replaces the item instead of duplicating it
+  void advance_incremental_rehash(const key_type &key) {
+    advance_incremental_rehash();
+    if (old_container_p_ == nullptr)
+      return;
+
+    // key may sit in the middle of a cluster, so the hole is closed as for
+    // any erase
+    auto index = find_old_item_index(key);
+    if (index != old_max_size_) {
+      migrate_bucket(index);
+      old_probe_fn_.erase_bucket(old_container_p_, old_max_size_, index,
+                                 hash_fn_, key_eq_fn_);
+    }
+  }
+
+  void complete_incremental_rehash() {
+    initialize_buckets(std::numeric_limits<size_type>::max());
+    migrate_buckets(std::numeric_limits<size_type>::max());
+  }
+
+  // every bucket of the old container must have been destroyed
+  void finish_incremental_rehash() {
+    traits_t::deallocate(alloc_, old_container_p_, old_max_size_);
+    old_probe_fn_.clear();
+    old_container_p_ = nullptr;
+    old_max_size_ = 0;
+    old_size_ = 0;
+    migrate_start_ = 0;
+    migrate_index_ = 0;
+  }
+
+  void erase_old_bucket(size_type index) {
+    release_node(old_container_p_[index]);
+    old_probe_fn_.erase_bucket(old_container_p_, old_max_size_, index,
+                               hash_fn_, key_eq_fn_);
+    old_size_--;
+    curr_size_--;
+  }
+
+  template <typename OnProbed = null_probe_length>
+  size_t find_old_item_index(const key_type &key,
+                             OnProbed on_probed = {}) const {
+    return old_probe_fn_.find_item_key(old_container_p_, old_max_size_, key,
+                                       hash_fn_, key_eq_fn_, on_probed);
+  }
+
+  bool is_in_old_container(const value_type *node) const {
+    return old_container_p_ != nullptr and node >= old_container_p_ and
+           node < old_container_p_ + old_max_size_;
+  }
+
+  // looks key up in the current container, then the old one
+  value_type *find_node(const key_type &key) const {
+    size_t probed = 0;
+    auto node = find_node(key, count_probes(probed));
+    stats_.record_lookup(probed, node != nullptr);
+    return node;
+  }
+
+  template <typename OnProbed>
+  value_type *find_node(const key_type &key, OnProbed on_probed) const {
+    auto index = find_item_index(key, on_probed);
+    if (index != max_size_)
+      return container_p_ + index;
+
+    if (old_container_p_ != nullptr) {
+      index = find_old_item_index(key, on_probed);
+      if (index != old_max_size_)
+        return old_container_p_ + index;
+    }
+
+    return nullptr;
+  }
+
+  // adds probe lengths up into probed if Stats records them
+  auto count_probes(size_t &probed) const {
+    if constexpr (Stats::enabled)
+      return [&probed](size_t length) { probed += length; };
+    else
+      return null_probe_length{};
+  }
+
+  // keys hashed and prefetched ahead of probing by batched lookups, enough
+  // to cover memory latency without spilling the hashes out of registers
+  static constexpr size_type kBatchChunk = 16;
+
+  /**
+   * @brief Resolves keys a chunk at a time, calling emit(i, node) with the
+   *        node holding keys[i] or nullptr, prefetching values of nodes that
+   *        point to them if PrefetchValues
+   */
+  template <bool PrefetchValues, typename Emit>
+  void find_nodes_batch(std::span<const key_type> keys, Emit &&emit) const {
+    if constexpr (not batch_probe<prober, key_type, key_equal>) {
+      for (size_type i = 0; i < keys.size(); i++)
+        emit(i, find_node(keys[i]));
+    } else {
+      size_t hashes[kBatchChunk];
+      value_type *nodes[kBatchChunk];
+
+      for (size_type base = 0; base < keys.size(); base += kBatchChunk) {
+        auto len = std::min(kBatchChunk, keys.size() - base);
+
+        for (size_type i = 0; i < len; i++) {
+          hashes[i] = hash_fn_(keys[base + i]);
+          if (max_size_ != 0)
+            probe_fn_.prefetch(container_p_, max_size_, hashes[i]);
+        }
+
+        for (size_type i = 0; i < len; i++) {
+          nodes[i] = find_node_hashed(keys[base + i], hashes[i]);
+          if constexpr (PrefetchValues and
+                        value_type::storage != node_storage::inline_value) {
+            if (nodes[i] != nullptr)
+              detail::prefetch(nodes[i]->t_p);
+          }
+        }
+
+        for (size_type i = 0; i < len; i++)
+          emit(base + i, nodes[i]);
+      }
+    }
+  }
+
+  // find_node for a key whose hash is already known
+  value_type *find_node_hashed(const key_type &key, size_t hash) const {
+    size_t probed = 0;
+    auto on_probed = count_probes(probed);
+    value_type *node = nullptr;
+
+    if (max_size_ != 0) {
+      auto index = probe_fn_.find_item_hashed(container_p_, max_size_, key,
+                                              hash, key_eq_fn_, on_probed);
+      if (index != max_size_)
+        node = container_p_ + index;
+    }
+
+    if (node == nullptr and old_container_p_ != nullptr) {
+      auto index = old_probe_fn_.find_item_hashed(
+          old_container_p_, old_max_size_, key, hash, key_eq_fn_, on_probed);
+      if (index != old_max_size_)
+        node = old_container_p_ + index;
+    }
+
+    stats_.record_lookup(probed, node != nullptr);
+    return node;
+  }
+
+  // iterator at node, or end() if node is null
+  Iterator make_iterator(value_type *node) const {
+    auto end = container_p_ + max_size_;
+    if (node == nullptr)
+      return Iterator(end, end);
+    if (not is_in_old_container(node))
+      return Iterator(node, end);
+
+    // the migrated buckets run down from migrate_start_, wrapping around
+    // to the end of the old container once they pass its first bucket
+    auto old_end = old_container_p_ + old_max_size_;
+    if (migrate_index_ == 0)
+      return Iterator(node, old_end, nullptr, nullptr, container_p_, end);
+    if (migrate_index_ <= migrate_start_)
+      return Iterator(node, old_end,
+                      old_container_p_ + migrate_start_ + 1 - migrate_index_,
+                      old_container_p_ + migrate_start_ + 1, container_p_,
+                      end);
+    return Iterator(node,
+                    old_end + migrate_start_ + 1 - migrate_index_, nullptr,
+                    nullptr, container_p_, end);
+  }
+
+  Iterator make_begin() const {
+    if (old_container_p_ == nullptr)
+      return Iterator(container_p_, container_p_ + max_size_);
+    // first bucket not migrated yet
+    if (migrate_index_ > migrate_start_)
+      return make_iterator(old_container_p_ + migrate_start_ + 1);
+    return make_iterator(old_container_p_);
+  }
+
   void rehash_into_new_container(value_type *old_container, size_t old_size,
                                  value_type *new_container, size_t new_size) {
     for (size_t i = 0; i < old_size; i++) {
-      if (container_p_[i].t_p == nullptr)
+      if (not old_container[i].occupied())
         continue;
 
       auto newBucketIndex = probe_fn_.get_empty_bucket_index(
-          new_container, new_size, container_p_[i].key, hash_fn_, key_eq_fn_);
-      new_container[newBucketIndex] = container_p_[i];
-      container_p_[i].t_p = nullptr;
+          new_container, new_size, old_container[i].key, hash_fn_, key_eq_fn_);
+      // moving hands the value over, so nothing is copied or reallocated
+      new_container[newBucketIndex] = std::move(old_container[i]);
+      old_container[i].reset();
     }
   }
 
-  size_t get_empty_bucket_index(const key_type &key) const {
-    return probe_fn_.get_empty_bucket_index(container_p_, max_size_, key,
-                                            hash_fn_, key_eq_fn_);
+  value_type *allocate_container(size_type size) {
+    auto container = traits_t::allocate(alloc_, size);
+    construct_buckets(container, 0, size);
+    return container;
+  }
+
+  void construct_buckets(value_type *container, size_type first,
+                         size_type last) {
+    for (size_type i = first; i < last; i++)
+      traits_t::construct(alloc_, container + i);
+  }
+
+  // values must have been released or moved out beforehand, only the first
+  // constructed buckets are destroyed
+  void deallocate_container(value_type *container, size_type size) {
+    deallocate_container(container, size, size);
+  }
+  void deallocate_container(value_type *container, size_type size,
+                            size_type constructed) {
+    for (size_type i = 0; i < constructed; i++)
+      traits_t::destroy(alloc_, container + i);
+    traits_t::deallocate(alloc_, container, size);
+  }
+
+  // frees the value held in node, leaving its bucket empty
+  void release_node(value_type &node) {
+    if constexpr (value_type::storage == node_storage::pooled)
+      value_pool_.destroy(node.t_p);
+    node.reset();
+  }
+
+  void erase_bucket(size_type index) {
+    release_node(container_p_[index]);
+    probe_fn_.erase_bucket(container_p_, max_size_, index, hash_fn_,
+                           key_eq_fn_);
+    curr_size_--;
+  }
+
+  // not const, stateful probes claim the returned bucket for key
+  size_t get_empty_bucket_index(const key_type &key) {
+    size_t probed = 0;
+    auto index = probe_fn_.get_empty_bucket_index(
+        container_p_, max_size_, key, hash_fn_, key_eq_fn_,
+        count_probes(probed));
+    stats_.record_insert(probed);
+    return index;
   }
 
-  size_t find_item_index(const key_type &key) const {
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_index(const key_type &key, OnProbed on_probed = {}) const {
+    // nothing has been allocated yet, so there is nothing to probe
+    if (max_size_ == 0)
+      return max_size_;
+
     return probe_fn_.find_item_key(container_p_, max_size_, key, hash_fn_,
-                                   key_eq_fn_);
+                                   key_eq_fn_, on_probed);
   }
 
   T &find_or_default_construct(const Key &key) {
-    auto itr = find(key);
-    if (itr != end())
-      return *itr->t_p;
+    if (auto node = find_node(key); node != nullptr)
+      return node->value();
 
-    auto [createdItr, isCreated] = insert(value_type(key));
-    return *(createdItr->t_p);
+    expand_container_if_load_factor_reached();
+    advance_incremental_rehash();
+    auto index = get_empty_bucket_index(key);
+
+    if constexpr (value_type::storage == node_storage::pooled)
+      container_p_[index] = value_type(key, value_pool_.create());
+    else
+      container_p_[index] = value_type(key);
+    curr_size_++;
+    return container_p_[index].value();
   }
 
   // TODO: Move optimizations
@@ -390,4 +1137,17 @@ private:
     return find_or_default_construct(key);
   }
 };
+
+/**
+ * @brief open_addressed_hash_map storing small trivially copyable values
+ *        inline in their bucket and larger ones in a value_pool, so inserting
+ *        never allocates per entry, see select_map_node
+ */
+template <typename Key, typename T, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<select_map_node<Key, T>>,
+          typename Probe = probe<Key, select_map_node<Key, T>, Hash, KeyEqual>,
+          typename Stats = no_map_stats>
+using inline_hash_map =
+    open_addressed_hash_map<Key, T, Hash, KeyEqual, Allocator, Probe, Stats>;
 }; // namespace nhzaci
@@ -1,19 +1,79 @@
 #pragma once
 
+#include <bit>
+#include <concepts>
+#include <cstddef>
 #include <iostream>
+#include <utility>
 
 namespace nhzaci {
 
+namespace detail {
+
+/**
+ * @brief Folds a 128-bit multiplication of the hash so that both the low and
+ *        the high bits depend on every input bit, identity hashes such as
+ *        std::hash<int> would otherwise cluster
+ */
+inline size_t mix_hash(size_t hash) noexcept {
+  auto m = static_cast<unsigned __int128>(hash) * 0x9E3779B97F4A7C15ull;
+  return static_cast<size_t>(m) ^ static_cast<size_t>(m >> 64);
+}
+
+// hints that p is about to be read, never faults even on invalid addresses
+inline void prefetch(const void *p) noexcept { __builtin_prefetch(p); }
+
+}; // namespace detail
+
+/**
+ * @brief Default probe length callback of every probe, discarding the length
+ *        so that uninstrumented hash maps pay nothing for it
+ */
+struct null_probe_length {
+  void operator()(size_t) const noexcept {}
+};
+
+/**
+ * @brief Maps a hash onto a home bucket by masking off its low bits,
+ *        max_size must be a power of two
+ */
+struct mask_index {
+  size_t operator()(size_t hash, size_t max_size) const noexcept {
+    return hash & (max_size - 1);
+  }
+};
+
+/**
+ * @brief Maps a hash onto a home bucket with fibonacci hashing, taking the
+ *        high bits of hash * 2^64 / phi so that weak hashes (e.g. identity
+ *        std::hash<int> over strided keys) do not cluster, max_size must be a
+ *        power of two
+ */
+struct fibonacci_index {
+  size_t operator()(size_t hash, size_t max_size) const noexcept {
+    if (max_size == 1)
+      return 0;
+    auto shift = 64 - std::countr_zero(max_size);
+    return (hash * 11400714819323198485ull) >> shift;
+  }
+};
+
 /**
  * @brief Probing function object encapsulates the algorithm required to
- *        carry out open addressing of a hash map.
+ *        carry out open addressing of a hash map. Wraps around with a mask, so
+ *        max_size must be a power of two.
  *
  * @tparam Key        Type of key object
  * @tparam ValueType  Type of mapped object
  * @tparam Hash       Hash function object from hash map
  * @tparam KeyEqual   Predicate function object from hash map
+ * @tparam Index      Maps a hash onto its home bucket, defaults to
+ *                    fibonacci_index, as identity hashes over sequential
+ *                    keys would otherwise pack into a single cluster that
+ *                    every backward shift erase walks to its end
  */
-template <typename Key, typename ValueType, typename Hash, typename KeyEqual>
+template <typename Key, typename ValueType, typename Hash, typename KeyEqual,
+          typename Index = fibonacci_index>
 struct probe {
   using value_type_p = ValueType *;
   using const_value_type_p = const ValueType *;
@@ -21,8 +81,26 @@ struct probe {
   using const_key_ref = const Key &;
   using const_key_equal_ref = const KeyEqual &;
 
-  // TODO: Add template concept for ValueType to contain key and t_p;
+  // TODO: Add template concept for ValueType to contain key, occupied() and
+  // reset();
   // TODO: Add template concept for Hash;
+
+  // linear probing keeps no state besides the container and the buckets
+  // released from it, stateful probes (re)build their metadata here whenever
+  // the hash map swaps containers
+  void resize(size_t) noexcept { clear(); }
+  // resize in two steps, so that an incremental rehash can spread
+  // initializing the metadata of buckets [first, last) over many inserts
+  void allocate(size_t) noexcept { clear(); }
+  void initialize(size_t, size_t, size_t) noexcept {}
+  void clear() noexcept {
+    released_first_ = kNoBucket;
+    released_ = 0;
+  }
+
+  // erasing shifts items back, so no deleted buckets are ever left behind
+  size_t deleted() const noexcept { return 0; }
+
   /**
    * @brief Probe and return index for next empty bucket
    *
@@ -34,22 +112,29 @@ struct probe {
    * @param max_size    max number of elements container contains
    * @param key         key of object we are trying to add in
    * @param hash_f      hash function that we are taking in
+   * @param on_probed   called with the number of buckets visited
    * @return size_t     returns first empty bucket from probing algorithm
    */
+  template <typename OnProbed = null_probe_length>
   size_t get_empty_bucket_index(value_type_p container, size_t max_size,
                                 const_key_ref key, const_hasher_ref hash_f,
-                                const_key_equal_ref equal_to_f) const noexcept {
-    auto bucket = hash_f(key) % max_size;
+                                const_key_equal_ref equal_to_f,
+                                OnProbed on_probed = {}) const noexcept {
+    auto mask = max_size - 1;
+    auto bucket = index_f_(hash_f(key), max_size);
+    size_t probed = 1;
 
     // Implicit assumption: buckets will NEVER be completely full and point back
     // to start i.e. starting bucket at 4, but entire array `container` is full,
     // so we wrap around back to 4, this will cause an infinite loop! But if the
     // load factor holds for a hash map, it should ALWAYS expand before it's 1.0
-    while (container[bucket].t_p != nullptr and
+    while (container[bucket].occupied() and
            not equal_to_f(key, container[bucket].key)) {
-      bucket = (bucket + 1) % max_size; // wrap around
+      bucket = (bucket + 1) & mask; // wrap around
+      probed++;
     }
 
+    on_probed(probed);
     return bucket;
   }
 
@@ -68,28 +153,151 @@ struct probe {
    * @param key         key of object we are trying to add in
    * @param hash_f      hash function that we are taking in
    * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of buckets visited
    * @return size_t     max_size if not found, otherwise index to item
    */
+  template <typename OnProbed = null_probe_length>
   size_t find_item_key(value_type_p container, size_t max_size,
                        const_key_ref key, const_hasher_ref hash_f,
-                       const_key_equal_ref equal_to_f) const noexcept {
-    auto hash = hash_f(key);
-    auto bucket = hash % max_size;
+                       const_key_equal_ref equal_to_f,
+                       OnProbed on_probed = {}) const noexcept {
+    return find_item_hashed(container, max_size, key, hash_f(key), equal_to_f,
+                            on_probed);
+  }
+
+  /**
+   * @brief find_item_key for a key whose hash is already known, used by
+   *        batched lookups that hash every key up front
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to find
+   * @param hash        hash_f(key)
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of buckets visited
+   * @return size_t     max_size if not found, otherwise index to item
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_hashed(value_type_p container, size_t max_size,
+                          const_key_ref key, size_t hash,
+                          const_key_equal_ref equal_to_f,
+                          OnProbed on_probed = {}) const noexcept {
+    auto mask = max_size - 1;
+    auto bucket = index_f_(hash, max_size);
+    size_t probed = 1;
+
+    // released buckets read as empty, and the first one ends every probe
+    // that runs into them from below
+    if (is_released(bucket, mask)) {
+      on_probed(probed);
+      return max_size;
+    }
 
     // Implicit assumption: there will not be an infinite loop as it eventually
     // reaches a bucket which is null, which is an invariant that should hold
     // true if the load factor is not 1.0
-    while (container[bucket].t_p != nullptr) {
+    while (bucket != released_first_ and container[bucket].occupied()) {
       // return key if found
-      if (equal_to_f(key, container[bucket].key))
+      if (equal_to_f(key, container[bucket].key)) {
+        on_probed(probed);
         return bucket;
-      bucket = (bucket + 1) % max_size;
+      }
+      bucket = (bucket + 1) & mask;
+      probed++;
     }
 
     // otherwise we reached a nullptr without finding a match, so no match is
     // found, return max_size which should return an itr end()
+    on_probed(probed);
     return max_size;
   }
+
+  // pulls the home bucket of a hash into cache ahead of find_item_hashed
+  void prefetch(value_type_p container, size_t max_size,
+                size_t hash) const noexcept {
+    detail::prefetch(container + index_f_(hash, max_size));
+  }
+
+  /**
+   * @brief Closes the hole left at bucket after its value has been released,
+   *        shifting back every following item of the cluster that may live
+   *        at or before the hole (Knuth's algorithm R), so lookups never need
+   *        tombstones
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param bucket      bucket whose node has already been emptied
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   */
+  void erase_bucket(value_type_p container, size_t max_size, size_t bucket,
+                    const_hasher_ref hash_f,
+                    [[maybe_unused]] const_key_equal_ref equal_to_f) const
+      noexcept {
+    auto mask = max_size - 1;
+    auto hole = bucket;
+    auto next = (bucket + 1) & mask;
+
+    while (next != released_first_ and container[next].occupied()) {
+      auto home = index_f_(hash_f(container[next].key), max_size);
+      // the item may move into the hole if the hole lies between its home
+      // bucket and where it currently sits
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        container[hole] = std::move(container[next]);
+        hole = next;
+      }
+      next = (next + 1) & mask;
+    }
+
+    // the last item moved still looks occupied for nodes without an owning
+    // pointer to null out
+    container[hole].reset();
+  }
+
+  /**
+   * @brief Releases an emptied bucket without closing the hole. Buckets are
+   *        released one below the other, starting from an empty bucket, so
+   *        that only the tail of a cluster is ever released and probes for
+   *        the items left never pass through it. Linear probing tells empty
+   *        buckets by their node, so the released range is kept here instead
+   *        and lookups and erases never read those nodes again, which leaves
+   *        the hash map free to destroy them.
+   *
+   * @param bucket      bucket whose node has already been emptied, just
+   * below the buckets released so far
+   */
+  void release_bucket(value_type_p, size_t, size_t bucket) noexcept {
+    released_first_ = bucket;
+    released_++;
+  }
+
+private:
+  static constexpr size_t kNoBucket = static_cast<size_t>(-1);
+
+  // released buckets are [released_first_, released_first_ + released_)
+  size_t released_first_ = kNoBucket;
+  size_t released_ = 0;
+  [[no_unique_address]] Index index_f_;
+
+  bool is_released(size_t bucket, size_t mask) const noexcept {
+    return ((bucket - released_first_) & mask) < released_;
+  }
+};
+
+/**
+ * @brief Probes that can look up a key by a precomputed hash and prefetch its
+ *        home bucket, which lets hash maps pipeline batched lookups. Other
+ *        probes fall back to one find_item_key at a time.
+ */
+template <typename Probe, typename Key, typename KeyEqual>
+concept batch_probe = requires(const Probe &probe_f,
+                               typename Probe::value_type_p container,
+                               size_t max_size, size_t hash, const Key &key,
+                               const KeyEqual &equal_to_f) {
+  probe_f.prefetch(container, max_size, hash);
+  {
+    probe_f.find_item_hashed(container, max_size, key, hash, equal_to_f)
+  } -> std::convertible_to<size_t>;
 };
 
 }; // namespace nhzaci
\ No newline at end of file
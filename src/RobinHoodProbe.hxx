@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "Probe.hxx"
+
+namespace nhzaci {
+
+/**
+ * @brief Probing function object implementing Robin Hood hashing, keeping the
+ *        probe distance of every bucket in an array next to the hash map's
+ *        container.
+ *
+ *        Items further from their home bucket take buckets from items closer
+ *        to theirs, so every cluster stays ordered by home bucket. Lookups
+ *        stop as soon as they pass a bucket whose item is closer to home than
+ *        the key would be, and only compare keys at a matching distance.
+ *        Erasing shifts the rest of the cluster back by one bucket, so no
+ *        tombstones build up. Requires max_size to be a power of two.
+ *
+ * @tparam Key        Type of key object
+ * @tparam ValueType  Type of mapped object
+ * @tparam Hash       Hash function object from hash map
+ * @tparam KeyEqual   Predicate function object from hash map
+ * @tparam Index      Maps a hash onto its home bucket, defaults to mask_index,
+ *                    use fibonacci_index for weak (e.g. identity) hashes
+ */
+template <typename Key, typename ValueType, typename Hash, typename KeyEqual,
+          typename Index = mask_index>
+struct robin_hood_probe {
+  using value_type_p = ValueType *;
+  using const_value_type_p = const ValueType *;
+  using const_hasher_ref = const Hash &;
+  using const_key_ref = const Key &;
+  using const_key_equal_ref = const KeyEqual &;
+  // 0 marks an empty bucket, otherwise probe distance from home + 1
+  using distance_t = std::uint32_t;
+
+  /**
+   * @brief Allocates a fresh distance array for an empty container, must be
+   *        called whenever the hash map swaps in a new container
+   *
+   * @param max_size    max number of elements the new container contains
+   */
+  void resize(size_t max_size) {
+    distance_ = std::make_unique<distance_t[]>(max_size);
+  }
+
+  // resize split in two, leaving buckets uninitialized until initialize
+  // marks [first, last) empty
+  void allocate(size_t max_size) {
+    distance_ = std::make_unique_for_overwrite<distance_t[]>(max_size);
+  }
+  void initialize(size_t, size_t first, size_t last) noexcept {
+    std::fill(distance_.get() + first, distance_.get() + last, 0);
+  }
+
+  void clear() noexcept { distance_.reset(); }
+
+  // erasing shifts items back, so no deleted buckets are ever left behind
+  size_t deleted() const noexcept { return 0; }
+
+  /**
+   * @brief Probe and return index for the bucket holding key if it exists,
+   *        otherwise the bucket key belongs in under Robin Hood ordering.
+   *        Items from that bucket onwards are shifted one bucket forward to
+   *        make room, so the returned bucket is always empty for a new key.
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to add in
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of buckets visited
+   * @return size_t     returns bucket key should be written into
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t get_empty_bucket_index(value_type_p container, size_t max_size,
+                                const_key_ref key, const_hasher_ref hash_f,
+                                const_key_equal_ref equal_to_f,
+                                OnProbed on_probed = {}) noexcept {
+    auto mask = max_size - 1;
+    auto bucket = index_f_(hash_f(key), max_size);
+    distance_t distance = 1;
+
+    while (distance_[bucket] >= distance) {
+      if (distance_[bucket] == distance and
+          equal_to_f(key, container[bucket].key)) {
+        on_probed(distance);
+        return bucket;
+      }
+      bucket = (bucket + 1) & mask;
+      distance++;
+    }
+
+    // either empty, or the resident is closer to home than key would be
+    if (distance_[bucket] != 0)
+      shift_forward(container, max_size, bucket);
+    distance_[bucket] = distance;
+    on_probed(distance);
+    return bucket;
+  }
+
+  /**
+   * @brief Probe for a certain key, returning max_size if no match is found
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to find
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of buckets visited
+   * @return size_t     max_size if not found, otherwise index to item
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_key(value_type_p container, size_t max_size,
+                       const_key_ref key, const_hasher_ref hash_f,
+                       const_key_equal_ref equal_to_f,
+                       OnProbed on_probed = {}) const noexcept {
+    return find_item_hashed(container, max_size, key, hash_f(key), equal_to_f,
+                            on_probed);
+  }
+
+  /**
+   * @brief find_item_key for a key whose hash is already known
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param key         key of object we are trying to find
+   * @param hash        hash_f(key)
+   * @param equal_to_f  equal to function object to check key equality
+   * @param on_probed   called with the number of buckets visited
+   * @return size_t     max_size if not found, otherwise index to item
+   */
+  template <typename OnProbed = null_probe_length>
+  size_t find_item_hashed(value_type_p container, size_t max_size,
+                          const_key_ref key, size_t hash,
+                          const_key_equal_ref equal_to_f,
+                          OnProbed on_probed = {}) const noexcept {
+    auto mask = max_size - 1;
+    auto bucket = index_f_(hash, max_size);
+    distance_t distance = 1;
+
+    // an empty bucket, or an item closer to its home than key would be,
+    // means key cannot be further along
+    while (distance_[bucket] >= distance) {
+      if (distance_[bucket] == distance and
+          equal_to_f(key, container[bucket].key)) {
+        on_probed(distance);
+        return bucket;
+      }
+      bucket = (bucket + 1) & mask;
+      distance++;
+    }
+
+    on_probed(distance);
+    return max_size;
+  }
+
+  // pulls the distance and the node of a hash's home bucket into cache
+  void prefetch(value_type_p container, size_t max_size,
+                size_t hash) const noexcept {
+    auto bucket = index_f_(hash, max_size);
+    detail::prefetch(distance_.get() + bucket);
+    detail::prefetch(container + bucket);
+  }
+
+  /**
+   * @brief Closes the hole left at bucket after its value has been released
+   *        by shifting the rest of the cluster back one bucket, stopping at
+   *        an empty bucket or an item already in its home bucket
+   *
+   * @param container   pointer to base container of the hash map
+   * @param max_size    max number of elements container contains
+   * @param bucket      bucket whose node has already been emptied
+   * @param hash_f      hash function that we are taking in
+   * @param equal_to_f  equal to function object to check key equality
+   */
+  void erase_bucket(value_type_p container, size_t max_size, size_t bucket,
+                    [[maybe_unused]] const_hasher_ref hash_f,
+                    [[maybe_unused]] const_key_equal_ref equal_to_f) noexcept {
+    auto mask = max_size - 1;
+    auto next = (bucket + 1) & mask;
+
+    while (distance_[next] > 1) {
+      container[bucket] = std::move(container[next]);
+      distance_[bucket] = distance_[next] - 1;
+      bucket = next;
+      next = (next + 1) & mask;
+    }
+
+    container[bucket].reset();
+    distance_[bucket] = 0;
+  }
+
+  /**
+   * @brief Releases an emptied bucket without shifting the rest of its
+   *        cluster back. Buckets are released one below the other, starting
+   *        from an empty bucket, so only the tail of a cluster is ever
+   *        released and probes for the items left never pass through it.
+   *        Probes read the distance before the node, so the node is never
+   *        read again and the hash map is free to destroy it.
+   *
+   * @param bucket      bucket whose node has already been emptied
+   */
+  void release_bucket(value_type_p, size_t, size_t bucket) noexcept {
+    distance_[bucket] = 0;
+  }
+
+private:
+  std::unique_ptr<distance_t[]> distance_;
+  [[no_unique_address]] Index index_f_;
+
+  // moves every item from bucket up to the next empty bucket one forward,
+  // leaving bucket empty
+  void shift_forward(value_type_p container, size_t max_size,
+                     size_t bucket) noexcept {
+    auto mask = max_size - 1;
+    auto empty = bucket;
+    while (distance_[empty] != 0)
+      empty = (empty + 1) & mask;
+
+    while (empty != bucket) {
+      auto prev = (empty - 1) & mask;
+      container[empty] = std::move(container[prev]);
+      distance_[empty] = distance_[prev] + 1;
+      empty = prev;
+    }
+
+    container[bucket].reset();
+  }
+};
+
+}; // namespace nhzaci
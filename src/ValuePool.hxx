@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace nhzaci {
+
+/**
+ * @brief Slab allocator for mapped objects of a hash map. Values are carved
+ *        out of slabs obtained from the allocator and recycled through an
+ *        intrusive free list, so creating a value is a pointer bump or pop
+ *        and a value never moves for as long as it lives.
+ *
+ *        The pool does not track live values, every value created must be
+ *        destroyed through the pool before the pool itself is released.
+ *
+ * @tparam T          Type of mapped objects
+ * @tparam Allocator  Allocator used for slabs, rebound to the slot type
+ */
+template <typename T, typename Allocator = std::allocator<T>>
+class value_pool {
+  union slot {
+    slot *next;
+    alignas(T) std::byte storage[sizeof(T)];
+  };
+
+  // every slab starts with a header linking it to the previous slab
+  struct slab {
+    slab *prev;
+    size_t capacity;
+  };
+
+  using slot_alloc_t =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<slot>;
+  using slot_traits_t = std::allocator_traits<slot_alloc_t>;
+  using value_alloc_t =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+  using value_traits_t = std::allocator_traits<value_alloc_t>;
+
+public:
+  static constexpr size_t kMinSlabSize = 16;
+  static constexpr size_t kMaxSlabSize = 4096;
+
+  value_pool() = default;
+  explicit value_pool(const Allocator &alloc) : alloc_{alloc} {};
+  ~value_pool() { release(); }
+
+  value_pool(const value_pool &) = delete;
+  value_pool &operator=(const value_pool &) = delete;
+
+  value_pool(value_pool &&other) noexcept
+      : alloc_{std::move(other.alloc_)},
+        free_list_{std::exchange(other.free_list_, nullptr)},
+        last_slab_{std::exchange(other.last_slab_, nullptr)},
+        bump_{std::exchange(other.bump_, nullptr)},
+        bump_end_{std::exchange(other.bump_end_, nullptr)},
+        slab_count_{std::exchange(other.slab_count_, 0)},
+        slab_bytes_{std::exchange(other.slab_bytes_, 0)} {}
+  value_pool &operator=(value_pool &&other) noexcept {
+    if (this != &other) {
+      release();
+      alloc_ = std::move(other.alloc_);
+      free_list_ = std::exchange(other.free_list_, nullptr);
+      last_slab_ = std::exchange(other.last_slab_, nullptr);
+      bump_ = std::exchange(other.bump_, nullptr);
+      bump_end_ = std::exchange(other.bump_end_, nullptr);
+      slab_count_ = std::exchange(other.slab_count_, 0);
+      slab_bytes_ = std::exchange(other.slab_bytes_, 0);
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Constructs a value in a free slot, allocating a new slab if none
+   *        is left. Slabs double in size up to kMaxSlabSize slots.
+   *
+   * @param args    arguments forwarded to the constructor of T
+   * @return T*     pointer to the value, stable until it is destroyed
+   */
+  template <typename... Args> T *create(Args &&...args) {
+    slot *s = free_list_;
+    if (s != nullptr) {
+      free_list_ = s->next;
+    } else {
+      if (bump_ == bump_end_)
+        grow();
+      s = bump_++;
+    }
+
+    auto t_p = reinterpret_cast<T *>(s->storage);
+    value_alloc_t value_alloc(alloc_);
+    value_traits_t::construct(value_alloc, t_p, std::forward<Args>(args)...);
+    return t_p;
+  }
+
+  // destroys the value and returns its slot to the free list
+  void destroy(T *t_p) {
+    value_alloc_t value_alloc(alloc_);
+    value_traits_t::destroy(value_alloc, t_p);
+
+    auto s = reinterpret_cast<slot *>(t_p);
+    s->next = free_list_;
+    free_list_ = s;
+  }
+
+  // hands every slab back to the allocator, all values must be destroyed
+  void release() noexcept {
+    while (last_slab_ != nullptr) {
+      auto prev = last_slab_->prev;
+      auto capacity = last_slab_->capacity;
+      slot_traits_t::deallocate(alloc_, reinterpret_cast<slot *>(last_slab_),
+                                capacity + header_slots());
+      last_slab_ = prev;
+    }
+
+    free_list_ = nullptr;
+    bump_ = nullptr;
+    bump_end_ = nullptr;
+    slab_count_ = 0;
+    slab_bytes_ = 0;
+  }
+
+  size_t slab_count() const noexcept { return slab_count_; }
+
+  // bytes obtained from the allocator, free slots included
+  size_t bytes() const noexcept { return slab_bytes_; }
+
+private:
+  slot_alloc_t alloc_;
+  slot *free_list_ = nullptr;
+  slab *last_slab_ = nullptr;
+  slot *bump_ = nullptr;
+  slot *bump_end_ = nullptr;
+  size_t slab_count_ = 0;
+  size_t slab_bytes_ = 0;
+
+  static constexpr size_t header_slots() noexcept {
+    return (sizeof(slab) + sizeof(slot) - 1) / sizeof(slot);
+  }
+
+  void grow() {
+    size_t capacity =
+        last_slab_ == nullptr
+            ? kMinSlabSize
+            : std::min(last_slab_->capacity * 2, kMaxSlabSize);
+
+    slot *slots = slot_traits_t::allocate(alloc_, capacity + header_slots());
+    auto header = ::new (static_cast<void *>(slots)) slab{last_slab_, capacity};
+
+    last_slab_ = header;
+    bump_ = slots + header_slots();
+    bump_end_ = bump_ + capacity;
+    slab_count_++;
+    slab_bytes_ += (capacity + header_slots()) * sizeof(slot);
+  }
+};
+
+/**
+ * @brief Stand-in for value_pool in hash maps whose nodes own their values
+ */
+struct no_value_pool {
+  no_value_pool() = default;
+  template <typename Allocator> explicit no_value_pool(const Allocator &) {}
+
+  void release() noexcept {}
+};
+
+}; // namespace nhzaci
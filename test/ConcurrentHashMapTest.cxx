@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/ConcurrentHashMap.hxx"
+
+using namespace nhzaci;
+
+class ConcurrentHashMapTest : public ::testing::Test {
+protected:
+  concurrent_hash_map<int, int> chm;
+};
+
+TEST_F(ConcurrentHashMapTest, chmInsertAndFind) {
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(chm.insert(i, i * 2));
+
+  EXPECT_EQ(chm.size(), 1000);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(chm.find(i), i * 2);
+    EXPECT_EQ(chm.at(i), i * 2);
+    EXPECT_TRUE(chm.contains(i));
+  }
+  EXPECT_EQ(chm.find(1000), std::nullopt);
+  EXPECT_EQ(chm.count(1000), 0);
+  EXPECT_THROW(chm.at(1000), std::out_of_range);
+}
+
+TEST_F(ConcurrentHashMapTest, chmInsertKeepsAndInsertOrAssignReplaces) {
+  EXPECT_TRUE(chm.insert(1, 10));
+  EXPECT_FALSE(chm.insert(1, 20));
+  EXPECT_EQ(chm.at(1), 10);
+
+  EXPECT_FALSE(chm.insert_or_assign(1, 30));
+  EXPECT_EQ(chm.at(1), 30);
+  EXPECT_TRUE(chm.insert_or_assign(2, 40));
+  EXPECT_EQ(chm.size(), 2);
+}
+
+TEST_F(ConcurrentHashMapTest, chmEraseLeavesLaterKeysReachable) {
+  for (int i = 0; i < 100; i++)
+    chm.insert(i, i);
+
+  for (int i = 0; i < 100; i += 2)
+    EXPECT_EQ(chm.erase(i), 1);
+  EXPECT_EQ(chm.erase(0), 0);
+  EXPECT_EQ(chm.size(), 50);
+
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(chm.contains(i), i % 2 == 1);
+
+  // erased keys come back into their old buckets
+  for (int i = 0; i < 100; i += 2)
+    EXPECT_TRUE(chm.insert(i, -i));
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(chm.at(i), i % 2 == 1 ? i : -i);
+}
+
+TEST_F(ConcurrentHashMapTest, chmChurnPurgesTombstonesWithoutGrowing) {
+  chm.reserve(64);
+  auto buckets = chm.bucket_count();
+
+  for (int i = 0; i < 10000; i++) {
+    chm.insert(i, i);
+    chm.erase(i);
+  }
+
+  EXPECT_TRUE(chm.empty());
+  EXPECT_EQ(chm.bucket_count(), buckets);
+}
+
+TEST_F(ConcurrentHashMapTest, chmVisitAndClear) {
+  concurrent_hash_map<std::string, std::string> strings;
+  strings.insert("key", "value");
+
+  std::string seen;
+  EXPECT_TRUE(strings.visit("key", [&](const std::string &v) { seen = v; }));
+  EXPECT_EQ(seen, "value");
+  EXPECT_FALSE(strings.visit("missing", [&](const std::string &) {}));
+
+  strings.clear();
+  EXPECT_TRUE(strings.empty());
+  EXPECT_FALSE(strings.contains("key"));
+}
+
+TEST_F(ConcurrentHashMapTest, chmReadersSeeConsistentValuesDuringWrites) {
+  constexpr int kKeys = 2000;
+  std::atomic<bool> done = false;
+  std::atomic<int> mismatches = 0;
+
+  // every value ever stored under key k is a multiple of k + 1, and keys
+  // below kKeys / 2 are never erased once inserted
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&] {
+      while (not done.load()) {
+        for (int k = 0; k < kKeys; k++) {
+          auto v = chm.find(k);
+          if (v.has_value() and *v % (k + 1) != 0)
+            mismatches++;
+        }
+      }
+    });
+  }
+
+  for (int k = 0; k < kKeys / 2; k++)
+    chm.insert(k, 0);
+  for (int round = 1; round < 50; round++) {
+    // grows and rebuilds the table while readers are probing it
+    for (int k = 0; k < kKeys; k++)
+      chm.insert_or_assign(k, (k + 1) * round);
+    for (int k = kKeys / 2; k < kKeys; k++)
+      chm.erase(k);
+  }
+  done.store(true);
+
+  for (auto &reader : readers)
+    reader.join();
+
+  EXPECT_EQ(mismatches.load(), 0);
+  EXPECT_EQ(chm.size(), kKeys / 2);
+  for (int k = 0; k < kKeys / 2; k++)
+    EXPECT_EQ(chm.at(k), (k + 1) * 49);
+}
+
+TEST_F(ConcurrentHashMapTest, chmReadersSurviveClearDuringWrites) {
+  constexpr int kKeys = 256;
+  std::atomic<bool> done = false;
+  std::atomic<int> mismatches = 0;
+
+  // values are only ever freed once no reader can reach them, which ASan
+  // checks for, and every value stored under key k is a multiple of k + 1
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&] {
+      while (not done.load()) {
+        for (int k = 0; k < kKeys; k++) {
+          auto v = chm.find(k);
+          if (v.has_value() and *v % (k + 1) != 0)
+            mismatches++;
+        }
+      }
+    });
+  }
+
+  for (int round = 1; round < 200; round++) {
+    for (int k = 0; k < kKeys; k++)
+      chm.insert_or_assign(k, (k + 1) * round);
+    chm.clear();
+  }
+  done.store(true);
+
+  for (auto &reader : readers)
+    reader.join();
+
+  EXPECT_EQ(mismatches.load(), 0);
+  EXPECT_TRUE(chm.empty());
+}
@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/FrozenHashMap.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+using namespace nhzaci;
+
+// built entirely at compile time
+static constexpr auto kExchangeCodes = make_frozen_hash_map<std::string_view,
+                                                            int>({
+    {"XNYS", 1},
+    {"XNAS", 2},
+    {"XLON", 3},
+    {"XPAR", 4},
+    {"XETR", 5},
+    {"XTKS", 6},
+    {"XHKG", 7},
+    {"XASX", 8},
+    {"a much longer code than the others", 9},
+    {"", 10},
+});
+
+static_assert(kExchangeCodes.size() == 10);
+static_assert(kExchangeCodes.at("XLON") == 3);
+static_assert(kExchangeCodes.at("a much longer code than the others") == 9);
+static_assert(kExchangeCodes.at("") == 10);
+static_assert(kExchangeCodes.contains("XHKG"));
+static_assert(not kExchangeCodes.contains("XLO"));
+static_assert(kExchangeCodes.count("BATS") == 0);
+
+enum class message_type : char { add = 'A', cancel = 'X', execute = 'E' };
+
+static constexpr auto kDispatch = make_frozen_hash_map<message_type, int>({
+    {message_type::add, 0},
+    {message_type::cancel, 1},
+    {message_type::execute, 2},
+});
+
+static_assert(kDispatch.at(message_type::execute) == 2);
+
+TEST(FrozenHashMapTest, fhmCompileTimeMapWorksAtRunTime) {
+  std::string code = "XETR";
+  EXPECT_EQ(kExchangeCodes.at(code), 5);
+  EXPECT_EQ(kExchangeCodes.find(code)->key, "XETR");
+  EXPECT_EQ(kExchangeCodes.find("BATS"), kExchangeCodes.end());
+  EXPECT_THROW(kExchangeCodes.at("BATS"), std::out_of_range);
+
+  int sum = 0;
+  for (auto &node : kExchangeCodes)
+    sum += node.value();
+  EXPECT_EQ(sum, 55);
+}
+
+TEST(FrozenHashMapTest, fhmBuiltFromOpenAddressedHashMap) {
+  open_addressed_hash_map<int64_t, int64_t> lhm;
+  for (int64_t i = 0; i < 100000; i++)
+    lhm[i * 3] = -i;
+
+  frozen_hash_map<int64_t, int64_t> fhm(lhm);
+  EXPECT_EQ(fhm.size(), 100000);
+  EXPECT_EQ(fhm.max_size(), fhm.size());
+  for (int64_t i = 0; i < 100000; i++) {
+    EXPECT_EQ(fhm.at(i * 3), -i);
+    EXPECT_FALSE(fhm.contains(i * 3 + 1));
+  }
+
+  // keys stay in the open_addressed_hash_map too
+  EXPECT_EQ(lhm.at(3), -1);
+}
+
+TEST(FrozenHashMapTest, fhmStringKeysBuiltAtRunTime) {
+  open_addressed_hash_map<std::string, int> lhm;
+  for (int i = 0; i < 5000; i++)
+    lhm["symbol" + std::to_string(i)] = i;
+
+  frozen_hash_map<std::string, int> fhm(lhm);
+  for (int i = 0; i < 5000; i++)
+    EXPECT_EQ(fhm.at("symbol" + std::to_string(i)), i);
+  EXPECT_FALSE(fhm.contains("symbol5000"));
+  EXPECT_FALSE(fhm.contains(""));
+}
+
+TEST(FrozenHashMapTest, fhmBuiltFromItemsRejectsDuplicates) {
+  std::vector<std::pair<int, int>> items = {{1, 1}, {2, 2}, {1, 3}};
+  EXPECT_THROW((frozen_hash_map<int, int>{items}), std::invalid_argument);
+
+  items.pop_back();
+  frozen_hash_map<int, int> fhm(items);
+  EXPECT_EQ(fhm.at(1), 1);
+  EXPECT_EQ(fhm.at(2), 2);
+}
+
+TEST(FrozenHashMapTest, fhmEmptyMap) {
+  open_addressed_hash_map<int, int> lhm;
+  frozen_hash_map<int, int> fhm(lhm);
+
+  EXPECT_TRUE(fhm.empty());
+  EXPECT_FALSE(fhm.contains(0));
+  EXPECT_EQ(fhm.begin(), fhm.end());
+}
+
+TEST(FrozenHashMapTest, fhmFrozenHashDependsOnSeed) {
+  frozen_hash<std::string> hash;
+  EXPECT_NE(hash("XNYS", 0), hash("XNYS", 1));
+  EXPECT_NE(hash("XNYS", 0), hash("XNYT", 0));
+  EXPECT_EQ(hash(std::string("XNYS"), 7),
+            frozen_hash<std::string_view>()("XNYS", 7));
+  EXPECT_NE(frozen_hash<int>()(1, 0), frozen_hash<int>()(1, 1));
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "../src/GroupProbe.hxx"
+#include "../src/MapStats.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+using namespace nhzaci;
+
+// forces every key into the same home bucket and the same hash fragment
+struct ConstantHash {
+  size_t operator()(int) const { return 42; }
+};
+
+template <typename Hash>
+using group_probed_map =
+    open_addressed_hash_map<int, int, Hash, std::equal_to<int>,
+                            std::allocator<MapNode<int, int>>,
+                            group_probe<int, MapNode<int, int>, Hash,
+                                        std::equal_to<int>>>;
+
+class GroupProbeTest : public ::testing::Test {
+protected:
+  group_probed_map<std::hash<int>> ghm;
+};
+
+TEST_F(GroupProbeTest, ghmFindOnEmptyMapIsEnd) {
+  EXPECT_TRUE(ghm.find(1) == ghm.end());
+  EXPECT_FALSE(ghm.contains(1));
+}
+
+TEST_F(GroupProbeTest, ghmFindsAllInsertedKeysAcrossExpansions) {
+  for (int i = 0; i < 1000; i++)
+    ghm[i] = i * 2;
+
+  EXPECT_EQ(ghm.size(), 1000);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(ghm.at(i), i * 2);
+  for (int i = 1000; i < 2000; i++)
+    EXPECT_FALSE(ghm.contains(i));
+}
+
+TEST_F(GroupProbeTest, ghmReplacesDupKeyValue) {
+  ghm.insert(MapNode(7, new int(1)));
+  ghm.insert(MapNode(7, new int(2)));
+  EXPECT_EQ(ghm.size(), 1);
+  EXPECT_EQ(ghm.at(7), 2);
+}
+
+TEST_F(GroupProbeTest, ghmClearThenReuse) {
+  ghm[1] = 1;
+  ghm.clear();
+  EXPECT_FALSE(ghm.contains(1));
+  ghm[2] = 2;
+  EXPECT_EQ(ghm.at(2), 2);
+}
+
+TEST(GroupProbeCollisionTest, ghmResolvesFullCollisionsByKey) {
+  group_probed_map<ConstantHash> ghm;
+  // spans several control groups with identical fragments
+  for (int i = 0; i < 100; i++)
+    ghm[i] = i;
+
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(ghm.at(i), i);
+  EXPECT_FALSE(ghm.contains(100));
+}
+
+TEST(GroupProbeCollisionTest, ghmEraseKeepsCollidingKeysReachable) {
+  group_probed_map<ConstantHash> ghm;
+  for (int i = 0; i < 100; i++)
+    ghm[i] = i;
+
+  for (int i = 0; i < 100; i += 2)
+    EXPECT_EQ(ghm.erase(i), 1);
+
+  EXPECT_EQ(ghm.size(), 50);
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(ghm.contains(i), i % 2 == 1);
+
+  // reinserting reuses deleted buckets
+  for (int i = 0; i < 100; i += 2)
+    ghm[i] = -i;
+  for (int i = 0; i < 100; i += 2)
+    EXPECT_EQ(ghm.at(i), -i);
+}
+
+// erasing and reinserting at a steady size must not let deleted buckets
+// take over the table, or every miss ends up scanning all of it
+TEST(GroupProbeChurnTest, ghmChurnKeepsMissesShort) {
+  using node_t = MapNode<int, int>;
+  open_addressed_hash_map<int, int, std::hash<int>, std::equal_to<int>,
+                          std::allocator<node_t>,
+                          group_probe<int, node_t, std::hash<int>,
+                                      std::equal_to<int>>,
+                          map_stats>
+      ghm;
+  ghm.reserve(12000);
+  auto buckets = ghm.max_size();
+  ASSERT_EQ(buckets, 16384);
+
+  for (int i = 0; i < 12000; i++)
+    ghm[i] = i;
+  for (int i = 12000; i < 400000; i++) {
+    EXPECT_EQ(ghm.erase(i - 12000), 1);
+    ghm[i] = i;
+  }
+
+  // grows once to leave room for deleted buckets, then drops them in place
+  EXPECT_EQ(ghm.size(), 12000);
+  EXPECT_EQ(ghm.max_size(), buckets * 2);
+
+  ghm.reset_stats();
+  for (int i = 0; i < 10000; i++)
+    EXPECT_FALSE(ghm.contains(-i - 1));
+  auto stats = ghm.stats();
+  EXPECT_LT(stats.misses.mean(), 4);
+  EXPECT_LE(stats.misses.longest, 32);
+}
+
+TEST_F(GroupProbeTest, ghmBatchLookupsMatchFind) {
+  for (int i = 0; i < 1000; i += 2)
+    ghm[i] = i;
+
+  std::vector<int> keys;
+  for (int i = 0; i < 200; i++)
+    keys.push_back(i * 5);
+  std::vector<const int *> values(keys.size());
+
+  std::as_const(ghm).find_batch(keys, values);
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] % 2 == 0 and keys[i] < 1000)
+      EXPECT_EQ(values[i], &ghm.at(keys[i]));
+    else
+      EXPECT_EQ(values[i], nullptr);
+  }
+}
+
+// every control_group build (scalar, SSE2, AVX2) has to agree with a plain
+// byte loop, the test target is built once per path
+TEST(ControlGroupTest, cgMatchesAgreeWithByteLoop) {
+  using ctrl_t = control_group::ctrl_t;
+  constexpr size_t kWidth = control_group::kWidth;
+  std::mt19937 gen(7);
+  std::vector<ctrl_t> ctrl(kWidth * 64);
+  for (auto &byte : ctrl) {
+    auto roll = gen() % 4;
+    byte = roll == 0   ? control_group::kEmpty
+           : roll == 1 ? control_group::kDeleted
+                       : static_cast<ctrl_t>(gen() & 0x7F);
+  }
+
+  for (size_t pos = 0; pos + kWidth <= ctrl.size(); pos++) {
+    control_group group(ctrl.data() + pos);
+    for (ctrl_t h2 : {ctrl_t{0}, ctrl_t{1}, ctrl[pos], ctrl_t{0x7F}}) {
+      control_group::mask_t expected = 0;
+      for (size_t i = 0; i < kWidth; i++)
+        expected |= static_cast<control_group::mask_t>(ctrl[pos + i] == h2)
+                    << i;
+      EXPECT_EQ(group.match(h2), expected);
+    }
+
+    control_group::mask_t empty = 0, free = 0;
+    for (size_t i = 0; i < kWidth; i++) {
+      empty |= static_cast<control_group::mask_t>(ctrl[pos + i] ==
+                                                  control_group::kEmpty)
+               << i;
+      free |= static_cast<control_group::mask_t>(ctrl[pos + i] < 0) << i;
+    }
+    EXPECT_EQ(group.match_empty(), empty);
+    EXPECT_EQ(group.match_empty_or_deleted(), free);
+  }
+}
+
+TEST(GroupProbeFullTableTest, ghmFullTableIsNeverIndexed) {
+  using node_t = MapNode<int, int>;
+  std::vector<node_t> container(16);
+  group_probe<int, node_t, std::hash<int>, std::equal_to<int>> probe;
+  probe.resize(container.size());
+
+  for (int i = 0; i < 16; i++) {
+    auto idx = probe.get_empty_bucket_index(container.data(), 16, i,
+                                            std::hash<int>(),
+                                            std::equal_to<int>());
+    ASSERT_LT(idx, 16);
+    container[idx].key = i;
+  }
+
+  EXPECT_DEBUG_DEATH(EXPECT_EQ(probe.get_empty_bucket_index(
+                                   container.data(), 16, 16, std::hash<int>(),
+                                   std::equal_to<int>()),
+                               16),
+                     "no free bucket left");
+}
@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/OpenAddressedHashMap.hxx"
+
+using namespace nhzaci;
+
+class IncrementalRehashTest : public ::testing::Test {
+protected:
+  void SetUp() override { ihm.incremental_rehash(true); }
+
+  // inserts keys 0, 1, ... until a large enough container starts being
+  // drained, returning how many keys were inserted
+  int fillUntilRehashing() {
+    int i = 0;
+    while (i < 32 or not ihm.is_rehashing()) {
+      ihm[i] = i;
+      i++;
+    }
+    return i;
+  }
+
+  open_addressed_hash_map<int, int> ihm;
+};
+
+TEST_F(IncrementalRehashTest, ihmFindsKeysInBothContainersWhileRehashing) {
+  bool sawRehashing = false;
+  for (int i = 0; i < 1000; i++) {
+    ihm[i] = i;
+    sawRehashing = sawRehashing or ihm.is_rehashing();
+
+    // every key inserted so far is reachable after every insert
+    for (int j = 0; j <= i; j += 37)
+      EXPECT_EQ(ihm.at(j), j);
+  }
+
+  EXPECT_TRUE(sawRehashing);
+  EXPECT_EQ(ihm.size(), 1000);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE(ihm.contains(i));
+  EXPECT_FALSE(ihm.contains(1000));
+}
+
+TEST_F(IncrementalRehashTest, ihmReplacesKeyStillInOldContainer) {
+  auto n = fillUntilRehashing();
+
+  for (int i = 0; i < n; i++)
+    ihm.insert(MapNode(i, new int(i * 10)));
+
+  EXPECT_EQ(ihm.size(), n);
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ(ihm.at(i), i * 10);
+}
+
+TEST_F(IncrementalRehashTest, ihmEraseAndIterateWhileRehashing) {
+  auto n = fillUntilRehashing();
+
+  int iterated = 0;
+  for (auto &node : ihm) {
+    EXPECT_EQ(*node.t_p, node.key);
+    iterated++;
+  }
+  EXPECT_EQ(iterated, n);
+
+  EXPECT_EQ(ihm.erase(0), 1);
+  EXPECT_EQ(ihm.erase(0), 0);
+  EXPECT_FALSE(ihm.contains(0));
+  EXPECT_EQ(ihm.size(), n - 1);
+}
+
+TEST_F(IncrementalRehashTest, ihmDisablingFinishesRehash) {
+  auto n = fillUntilRehashing();
+
+  ihm.incremental_rehash(false);
+  EXPECT_FALSE(ihm.is_rehashing());
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ(ihm.at(i), i);
+}
+
+TEST(RehashTest, lhmReserveAvoidsGrowth) {
+  open_addressed_hash_map<int, int> lhm;
+  lhm.reserve(1000);
+  auto buckets = lhm.max_size();
+  EXPECT_GE(buckets * lhm.max_load_factor(), 1000);
+
+  for (int i = 0; i < 1000; i++)
+    lhm[i] = i;
+  EXPECT_EQ(lhm.max_size(), buckets);
+}
+
+TEST(RehashTest, lhmRehashKeepsItemsAndRoundsToPowerOfTwo) {
+  open_addressed_hash_map<int, int> lhm;
+  for (int i = 0; i < 10; i++)
+    lhm[i] = i;
+
+  lhm.rehash(100);
+  EXPECT_EQ(lhm.max_size(), 128);
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(lhm.at(i), i);
+
+  // never shrinks below what size() needs
+  lhm.rehash(0);
+  EXPECT_EQ(lhm.max_size(), 16);
+  EXPECT_EQ(lhm.size(), 10);
+}
+
+TEST_F(IncrementalRehashTest, ihmBatchFindsKeysInBothContainers) {
+  auto n = fillUntilRehashing();
+
+  std::vector<int> keys;
+  for (int i = 0; i < n + 10; i++)
+    keys.push_back(i);
+  auto found = std::make_unique<bool[]>(keys.size());
+
+  ihm.contains_batch(keys, {found.get(), keys.size()});
+  for (int i = 0; i < n + 10; i++)
+    EXPECT_EQ(found[i], i < n);
+}
+
+// sequential keys under an identity hash and a masked index pack into a
+// single cluster, which must still drain in time linear in its size
+TEST(IncrementalRehashDenseTest, ihmDenseKeysDrainInLinearTime) {
+  using node_t = MapNode<int, int>;
+  open_addressed_hash_map<int, int, std::hash<int>, std::equal_to<int>,
+                          std::allocator<node_t>,
+                          probe<int, node_t, std::hash<int>,
+                                std::equal_to<int>, mask_index>>
+      dhm;
+  dhm.incremental_rehash(true);
+
+  constexpr int kKeys = 1 << 18;
+  bool sawRehashing = false;
+  for (int i = 0; i < kKeys; i++) {
+    dhm[i] = i;
+    if (dhm.is_rehashing() and i % 1024 == 0) {
+      sawRehashing = true;
+      EXPECT_EQ(dhm.at(i / 2), i / 2);
+      EXPECT_FALSE(dhm.contains(i + 1));
+    }
+  }
+
+  EXPECT_TRUE(sawRehashing);
+  EXPECT_EQ(dhm.size(), kKeys);
+  for (int i = 0; i < kKeys; i++)
+    EXPECT_EQ(dhm.at(i), i);
+}
+
+// identity hash counting the items hashed, once per lookup and once for
+// every item migrated
+struct CountingHash {
+  static inline size_t calls = 0;
+  size_t operator()(int key) const {
+    calls++;
+    return static_cast<size_t>(key);
+  }
+};
+
+// counts the buckets constructed and destroyed through any copy of it
+template <typename U> struct BucketCountingAllocator {
+  using value_type = U;
+
+  BucketCountingAllocator() = default;
+  template <typename V>
+  BucketCountingAllocator(const BucketCountingAllocator<V> &) {}
+
+  U *allocate(size_t n) { return std::allocator<U>().allocate(n); }
+  void deallocate(U *p, size_t n) { std::allocator<U>().deallocate(p, n); }
+
+  template <typename... Args> void construct(U *p, Args &&...args) {
+    constructed++;
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+  void destroy(U *p) {
+    destroyed++;
+    p->~U();
+  }
+
+  friend bool operator==(const BucketCountingAllocator &,
+                         const BucketCountingAllocator &) {
+    return true;
+  }
+
+  static inline size_t constructed = 0;
+  static inline size_t destroyed = 0;
+};
+
+// the dense keys above again, whose clusters span most of the container,
+// yet no insert may migrate, construct or destroy more than a few buckets
+TEST(IncrementalRehashDenseTest, ihmEveryInsertDoesBoundedWork) {
+  using node_t = MapNode<int, int>;
+  using alloc_t = BucketCountingAllocator<node_t>;
+  open_addressed_hash_map<int, int, CountingHash, std::equal_to<int>, alloc_t,
+                          probe<int, node_t, CountingHash, std::equal_to<int>,
+                                mask_index>>
+      dhm;
+  dhm.incremental_rehash(true);
+
+  constexpr int kKeys = 1 << 18;
+  size_t maxHashes = 0, maxConstructed = 0, maxDestroyed = 0;
+  int rehashingChecks = 0;
+  for (int i = 0; i < kKeys; i++) {
+    auto hashes = CountingHash::calls;
+    auto constructed = alloc_t::constructed;
+    auto destroyed = alloc_t::destroyed;
+    dhm[i] = i;
+    maxHashes = std::max(maxHashes, CountingHash::calls - hashes);
+    maxConstructed =
+        std::max(maxConstructed, alloc_t::constructed - constructed);
+    maxDestroyed = std::max(maxDestroyed, alloc_t::destroyed - destroyed);
+
+    // iterating skips the buckets already migrated out of the old container
+    if (dhm.is_rehashing() and i % 4096 == 0) {
+      rehashingChecks++;
+      int items = 0;
+      for (auto &node : dhm)
+        items += node.key <= i;
+      EXPECT_EQ(items, i + 1);
+    }
+  }
+
+  EXPECT_GT(rehashingChecks, 0);
+  EXPECT_EQ(dhm.size(), kKeys);
+  // a lookup in each container, the insert itself and 8 migrated items
+  EXPECT_LE(maxHashes, 12);
+  // 64 buckets of the next container, and 8 of the old one
+  EXPECT_LE(maxConstructed, 64);
+  EXPECT_LE(maxDestroyed, 8);
+}
+
+// eight keys to every home bucket, so clusters run across many buckets
+struct CoarseHash {
+  size_t operator()(int key) const { return static_cast<size_t>(key) / 8; }
+};
+
+TEST(IncrementalRehashChurnTest, ihmChurnWhileRehashingMatchesReference) {
+  open_addressed_hash_map<int, int, CoarseHash> chm;
+  chm.incremental_rehash(true);
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> keys(0, 1 << 14);
+  std::unordered_map<int, int> reference;
+
+  bool sawRehashing = false;
+  for (int i = 0; i < 100000; i++) {
+    auto key = keys(gen);
+    if (gen() % 4) {
+      chm[key] = i;
+      reference[key] = i;
+    } else {
+      EXPECT_EQ(chm.erase(key), reference.erase(key));
+    }
+
+    if (chm.is_rehashing()) {
+      sawRehashing = true;
+      for (int near = key - 8; near <= key + 8; near++)
+        EXPECT_EQ(chm.contains(near), reference.contains(near));
+    }
+  }
+
+  EXPECT_TRUE(sawRehashing);
+  EXPECT_EQ(chm.size(), reference.size());
+  for (auto &[key, value] : reference)
+    EXPECT_EQ(chm.at(key), value);
+}
+
+// stops at every point of growing, including while the next container is
+// only partly initialized
+TEST(IncrementalRehashGrowTest, ihmMoveAndClearAtAnyPointOfGrowing) {
+  for (int n = 1; n < 700; n += 7) {
+    open_addressed_hash_map<int, int> ihm;
+    ihm.incremental_rehash(true);
+    for (int i = 0; i < n; i++)
+      ihm[i] = i;
+
+    auto moved = std::move(ihm);
+    EXPECT_EQ(moved.size(), n);
+    for (int i = 0; i < n; i++)
+      EXPECT_EQ(moved.at(i), i);
+
+    moved.clear();
+    EXPECT_FALSE(moved.contains(0));
+    moved[n] = n;
+    EXPECT_EQ(moved.at(n), n);
+  }
+}
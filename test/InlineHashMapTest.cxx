@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <array>
+
+#include "../src/OpenAddressedHashMap.hxx"
+#include "../src/RobinHoodProbe.hxx"
+
+using namespace nhzaci;
+
+struct LargeValue {
+  std::array<long, 16> data{};
+};
+
+// counts every allocation made through any rebound copy of the allocator
+inline size_t countingAllocations = 0;
+
+template <typename U> struct CountingAllocator {
+  using value_type = U;
+
+  CountingAllocator() = default;
+  template <typename V> CountingAllocator(const CountingAllocator<V> &) {}
+
+  U *allocate(size_t n) {
+    countingAllocations++;
+    return std::allocator<U>().allocate(n);
+  }
+  void deallocate(U *p, size_t n) { std::allocator<U>().deallocate(p, n); }
+
+  friend bool operator==(const CountingAllocator &,
+                         const CountingAllocator &) {
+    return true;
+  }
+};
+
+// stateful, so only copies of the instance handed to the map count into it
+template <typename U> struct ArenaAllocator {
+  using value_type = U;
+
+  explicit ArenaAllocator(size_t *allocations) : allocations{allocations} {}
+  template <typename V>
+  ArenaAllocator(const ArenaAllocator<V> &other)
+      : allocations{other.allocations} {}
+
+  U *allocate(size_t n) {
+    (*allocations)++;
+    return std::allocator<U>().allocate(n);
+  }
+  void deallocate(U *p, size_t n) { std::allocator<U>().deallocate(p, n); }
+
+  friend bool operator==(const ArenaAllocator &lhs, const ArenaAllocator &rhs) {
+    return lhs.allocations == rhs.allocations;
+  }
+
+  size_t *allocations;
+};
+
+TEST(InlineHashMapTest, ihmSmallValuesAreStoredInline) {
+  static_assert(std::is_same_v<inline_hash_map<int, int>::value_type,
+                               InlineMapNode<int, int>>);
+  static_assert(std::is_trivially_copyable_v<InlineMapNode<int, int>>);
+
+  inline_hash_map<int, int> ihm;
+  for (int i = 0; i < 1000; i++)
+    ihm[i] = i * 3;
+
+  EXPECT_EQ(ihm.size(), 1000);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(ihm.at(i), i * 3);
+  EXPECT_FALSE(ihm.contains(1000));
+  EXPECT_EQ(&ihm.find(5)->value(), &ihm.at(5));
+}
+
+TEST(InlineHashMapTest, ihmInsertReplacesAndEraseEmpties) {
+  inline_hash_map<int, int> ihm;
+  ihm.insert(InlineMapNode(1, 10));
+  ihm.insert(InlineMapNode(1, 20));
+  EXPECT_EQ(ihm.size(), 1);
+  EXPECT_EQ(ihm.at(1), 20);
+  EXPECT_EQ(ihm.erase(1), 1);
+  EXPECT_TRUE(ihm.empty());
+  EXPECT_FALSE(ihm.contains(1));
+}
+
+TEST(InlineHashMapTest, ihmInlineNodesShiftWithRobinHoodProbe) {
+  using node_t = InlineMapNode<int, int>;
+  inline_hash_map<int, int, std::hash<int>, std::equal_to<int>,
+                  std::allocator<node_t>,
+                  robin_hood_probe<int, node_t, std::hash<int>,
+                                   std::equal_to<int>, fibonacci_index>>
+      ihm;
+  for (int i = 0; i < 500; i++)
+    ihm[i] = i;
+  for (int i = 0; i < 500; i += 3)
+    EXPECT_EQ(ihm.erase(i), 1);
+
+  EXPECT_EQ(ihm.size(), 333);
+  for (int i = 0; i < 500; i++)
+    EXPECT_EQ(ihm.contains(i), i % 3 != 0);
+}
+
+TEST(InlineHashMapTest, ihmLargeValuesArePooledAndStable) {
+  static_assert(std::is_same_v<inline_hash_map<int, LargeValue>::value_type,
+                               PooledMapNode<int, LargeValue>>);
+
+  inline_hash_map<int, LargeValue> ihm;
+  ihm[0].data[0] = 42;
+  auto *first = &ihm.at(0);
+
+  // growth moves nodes but never the pooled values
+  for (int i = 1; i < 1000; i++)
+    ihm[i].data[0] = i;
+
+  EXPECT_EQ(first, &ihm.at(0));
+  EXPECT_EQ(ihm.at(0).data[0], 42);
+  EXPECT_EQ(ihm.at(999).data[0], 999);
+
+  EXPECT_EQ(ihm.erase(0), 1);
+  EXPECT_FALSE(ihm.contains(0));
+  EXPECT_EQ(ihm.size(), 999);
+}
+
+TEST(InlineHashMapTest, ihmUsesAllocatorForSlotsAndValues) {
+  using node_t = PooledMapNode<int, LargeValue>;
+  inline_hash_map<int, LargeValue, std::hash<int>, std::equal_to<int>,
+                  CountingAllocator<node_t>>
+      ihm;
+
+  countingAllocations = 0;
+  for (int i = 0; i < 1000; i++)
+    ihm[i].data[0] = i;
+
+  // one allocation per growth step plus a handful of slabs, not per entry
+  EXPECT_GT(countingAllocations, 0);
+  EXPECT_LT(countingAllocations, 30);
+}
+
+TEST(InlineHashMapTest, ihmPooledValuesUseTheMapsAllocator) {
+  using node_t = PooledMapNode<int, LargeValue>;
+  using arena_map =
+      inline_hash_map<int, LargeValue, std::hash<int>, std::equal_to<int>,
+                      ArenaAllocator<node_t>>;
+
+  size_t allocations = 0;
+  arena_map ihm(ArenaAllocator<node_t>{&allocations});
+  ihm[0].data[0] = 1;
+  // one container and one slab
+  EXPECT_EQ(allocations, 2);
+
+  arena_map moved(std::move(ihm));
+  EXPECT_EQ(moved.get_allocator().allocations, &allocations);
+  for (int i = 1; i < 1000; i++)
+    moved[i].data[0] = i;
+  EXPECT_GT(allocations, 2);
+  EXPECT_EQ(moved.at(999).data[0], 999);
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <array>
+#include <thread>
+#include <vector>
+
+#include "../src/GroupProbe.hxx"
+#include "../src/MapStats.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+using namespace nhzaci;
+
+static_assert(std::is_empty_v<no_map_stats>,
+              "uninstrumented hash maps must not grow");
+
+// the size of the uninstrumented maps on LP64 targets, update it only along
+// with a member added to the hash map or its probe
+static_assert(sizeof(void *) != 8 or
+                  sizeof(open_addressed_hash_map<int, int>) == 160,
+              "uninstrumented hash maps must not grow");
+static_assert(sizeof(void *) != 8 or sizeof(inline_hash_map<int, int>) == 160,
+              "uninstrumented hash maps must not grow");
+
+using stats_map =
+    open_addressed_hash_map<int, int, std::hash<int>, std::equal_to<int>,
+                            std::allocator<MapNode<int, int>>,
+                            probe<int, MapNode<int, int>, std::hash<int>,
+                                  std::equal_to<int>, mask_index>,
+                            map_stats>;
+
+class MapStatsTest : public ::testing::Test {
+protected:
+  // identity hashed keys 0..99 all sit in their home bucket
+  void SetUp() override {
+    for (int i = 0; i < 100; i++)
+      shm[i] = i;
+  }
+
+  stats_map shm;
+};
+
+TEST_F(MapStatsTest, statsRecordsHitsMissesAndInserts) {
+  for (int i = 0; i < 100; i++)
+    EXPECT_TRUE(shm.contains(i));
+  for (int i = 1000; i < 1010; i++)
+    EXPECT_FALSE(shm.contains(i));
+
+  auto stats = shm.stats();
+  EXPECT_EQ(stats.hits.total, 100);
+  EXPECT_EQ(stats.hits.longest, 1);
+  EXPECT_EQ(stats.hits.percentile(0.99), 1);
+  // operator[] looked every key up before inserting it
+  EXPECT_EQ(stats.misses.total, 110);
+  EXPECT_EQ(stats.inserts.total, 100);
+  EXPECT_EQ(stats.inserts.counts[1], 100);
+  EXPECT_EQ(stats.longest_probe, 1);
+}
+
+TEST_F(MapStatsTest, statsCountsResizesAndBytes) {
+  auto stats = shm.stats();
+  // 4 buckets doubled up to 256
+  EXPECT_EQ(stats.bucket_count, 256);
+  EXPECT_EQ(stats.resizes, 6);
+  EXPECT_GT(stats.rehash_time.count(), 0);
+  EXPECT_EQ(stats.size, 100);
+  EXPECT_EQ(stats.slot_bytes, 256 * sizeof(MapNode<int, int>));
+  EXPECT_EQ(stats.value_bytes, 100 * sizeof(int));
+
+  shm.reset_stats();
+  EXPECT_EQ(shm.stats().resizes, 0);
+  EXPECT_EQ(shm.stats().inserts.total, 0);
+}
+
+TEST_F(MapStatsTest, statsProbeLengthsGrowWithCollisions) {
+  stats_map colliding;
+  colliding.rehash(64);
+  // every key shares home bucket 0
+  for (int i = 0; i < 8; i++)
+    colliding[i * 64] = i;
+
+  auto stats = colliding.stats();
+  EXPECT_EQ(stats.inserts.longest, 8);
+  EXPECT_EQ(stats.inserts.sum, 1 + 2 + 3 + 4 + 5 + 6 + 7 + 8);
+  // the miss before inserting i * 64 walked over the i keys before it
+  EXPECT_EQ(stats.misses.longest, 8);
+}
+
+TEST_F(MapStatsTest, statsCountEveryLookupOfConcurrentReaders) {
+  constexpr int kReaders = 4;
+  constexpr int kRounds = 1000;
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaders; r++)
+    readers.emplace_back([this] {
+      const auto &map = shm;
+      for (int round = 0; round < kRounds; round++)
+        for (int i = 0; i < 100; i++)
+          EXPECT_TRUE(map.contains(i));
+    });
+  for (auto &reader : readers)
+    reader.join();
+
+  auto stats = shm.stats();
+  EXPECT_EQ(stats.hits.total, kReaders * kRounds * 100);
+  EXPECT_EQ(stats.hits.counts[1], stats.hits.total);
+  EXPECT_EQ(stats.hits.longest, 1);
+}
+
+TEST_F(MapStatsTest, scanClustersMeasuresRuns) {
+  stats_map clustered;
+  clustered.rehash(16);
+  // 31 wraps from bucket 15 into bucket 0, joining 15 and 1..3 into one run
+  for (int key : {1, 2, 3, 5, 10, 11, 15, 31})
+    clustered[key] = key;
+
+  auto clusters = clustered.scan_clusters();
+  EXPECT_EQ(clusters.clusters, 3);
+  EXPECT_EQ(clusters.occupied, 8);
+  EXPECT_EQ(clusters.longest, 5);
+  EXPECT_EQ(clusters.counts[1], 1);
+  EXPECT_EQ(clusters.counts[2], 1);
+  EXPECT_EQ(clusters.counts[5], 1);
+}
+
+TEST(MapStatsPolicyTest, statsWorkWithPooledValuesAndGroupProbe) {
+  struct Wide {
+    std::array<long, 8> data{};
+  };
+  using node_t = select_map_node<int, Wide>;
+  inline_hash_map<int, Wide, std::hash<int>, std::equal_to<int>,
+                  std::allocator<node_t>,
+                  group_probe<int, node_t, std::hash<int>, std::equal_to<int>>,
+                  map_stats>
+      ghm;
+  for (int i = 0; i < 1000; i++)
+    ghm[i].data[0] = i;
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(ghm.at(i).data[0], i);
+
+  auto stats = ghm.stats();
+  EXPECT_EQ(stats.hits.total, 1000);
+  EXPECT_EQ(stats.inserts.total, 1000);
+  EXPECT_GE(stats.value_bytes, 1000 * sizeof(Wide));
+  EXPECT_EQ(ghm.scan_clusters().occupied, 1000);
+}
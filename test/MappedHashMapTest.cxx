@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/GroupProbe.hxx"
+#include "../src/MappedHashMap.hxx"
+#include "../src/OpenAddressedHashMap.hxx"
+
+using namespace nhzaci;
+
+struct Quote {
+  double price;
+  int32_t size;
+};
+
+class MappedHashMapTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    path = (std::filesystem::temp_directory_path() /
+            ("nhzaci_" +
+             std::string(::testing::UnitTest::GetInstance()
+                             ->current_test_info()
+                             ->name()) +
+             ".snap"))
+               .string();
+
+    for (int64_t i = 0; i < 10000; i++)
+      lhm[i * 7] = Quote{i * 0.5, static_cast<int32_t>(i)};
+  }
+
+  void TearDown() override { std::filesystem::remove(path); }
+
+  // overwrites the byte at offset of the snapshot
+  void corrupt(size_t offset) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(offset);
+    char byte = static_cast<char>(file.get());
+    file.seekp(offset);
+    file.put(static_cast<char>(byte ^ 0x5a));
+  }
+
+  // counts temporary files save() left next to the snapshot
+  int leftover_temp_files() const {
+    auto snapshot = std::filesystem::path(path);
+    auto prefix = snapshot.filename().string() + ".";
+    int leftover = 0;
+    for (auto &entry :
+         std::filesystem::directory_iterator(snapshot.parent_path()))
+      if (entry.path().filename().string().starts_with(prefix))
+        leftover++;
+    return leftover;
+  }
+
+  std::string path;
+  open_addressed_hash_map<int64_t, Quote> lhm;
+};
+
+TEST_F(MappedHashMapTest, mhmServesLookupsFromSavedMap) {
+  save(lhm, path);
+  mapped_hash_map<int64_t, Quote> mhm(path);
+
+  EXPECT_EQ(mhm.size(), 10000);
+  EXPECT_GT(mhm.max_size(), mhm.size());
+  for (int64_t i = 0; i < 10000; i++) {
+    EXPECT_TRUE(mhm.contains(i * 7));
+    EXPECT_EQ(mhm.count(i * 7), 1);
+    EXPECT_EQ(mhm.at(i * 7).price, i * 0.5);
+    EXPECT_EQ(mhm.find(i * 7)->value().size, i);
+  }
+  EXPECT_FALSE(mhm.contains(1));
+  EXPECT_EQ(mhm.find(1), mhm.end());
+  EXPECT_THROW(mhm.at(1), std::out_of_range);
+
+  size_t items = 0;
+  for (auto &node : mhm) {
+    EXPECT_EQ(node.key % 7, 0);
+    items++;
+  }
+  EXPECT_EQ(items, 10000);
+}
+
+TEST_F(MappedHashMapTest, mhmSavesAnyLayoutMidRehash) {
+  using node_t = InlineMapNode<int64_t, Quote>;
+  inline_hash_map<int64_t, Quote, std::hash<int64_t>, std::equal_to<int64_t>,
+                  std::allocator<node_t>,
+                  group_probe<int64_t, node_t, std::hash<int64_t>,
+                              std::equal_to<int64_t>>>
+      ghm;
+  ghm.incremental_rehash(true);
+  // grows to 2048 buckets at the 769th insert, leaving most of the old
+  // container to migrate
+  for (int64_t i = 0; i < 800; i++)
+    ghm[i] = Quote{static_cast<double>(i), 1};
+  ASSERT_TRUE(ghm.is_rehashing());
+
+  save(ghm, path);
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  EXPECT_EQ(mhm.size(), 800);
+  for (int64_t i = 0; i < 800; i++)
+    EXPECT_EQ(mhm.at(i).price, i);
+}
+
+TEST_F(MappedHashMapTest, mhmCopyOnWriteNeverTouchesFile) {
+  save(lhm, path);
+  {
+    mapped_hash_map<int64_t, Quote> mhm(path, snapshot_access::copy_on_write);
+    mhm.writable_at(7).price = -1;
+    EXPECT_EQ(mhm.at(7).price, -1);
+  }
+
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  EXPECT_EQ(mhm.at(7).price, 0.5);
+  EXPECT_THROW(mhm.writable_at(7), std::logic_error);
+}
+
+TEST_F(MappedHashMapTest, mhmEmptyMapRoundTrips) {
+  open_addressed_hash_map<int64_t, Quote> empty;
+  save(empty, path);
+
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  EXPECT_TRUE(mhm.empty());
+  EXPECT_FALSE(mhm.contains(0));
+  EXPECT_EQ(mhm.begin(), mhm.end());
+}
+
+TEST_F(MappedHashMapTest, mhmMovesOwnershipOfMapping) {
+  save(lhm, path);
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  mapped_hash_map<int64_t, Quote> moved(std::move(mhm));
+
+  EXPECT_TRUE(mhm.empty());
+  EXPECT_FALSE(mhm.contains(7));
+  EXPECT_TRUE(moved.contains(7));
+}
+
+TEST_F(MappedHashMapTest, mhmSaveReplacesSnapshotWholesale) {
+  save(lhm, path);
+  lhm[1] = Quote{-1, -1};
+  save(lhm, path);
+  EXPECT_EQ(leftover_temp_files(), 0);
+
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  EXPECT_EQ(mhm.size(), 10001);
+  EXPECT_EQ(mhm.at(1).price, -1);
+
+  auto missing = (std::filesystem::path(path) / "no_such_dir.snap").string();
+  EXPECT_THROW(save(lhm, missing), std::system_error);
+}
+
+TEST_F(MappedHashMapTest, mhmConcurrentSavesLeaveOneWholeSnapshot) {
+  // every saver writes its own temporary file, so whichever rename lands
+  // last leaves a complete snapshot behind
+  std::vector<std::thread> savers;
+  for (int s = 0; s < 4; s++)
+    savers.emplace_back([&] {
+      for (int round = 0; round < 8; round++)
+        save(lhm, path);
+    });
+  for (auto &saver : savers)
+    saver.join();
+
+  EXPECT_EQ(leftover_temp_files(), 0);
+  mapped_hash_map<int64_t, Quote> mhm(path);
+  EXPECT_EQ(mhm.size(), 10000);
+  EXPECT_EQ(mhm.at(7).size, 1);
+}
+
+TEST_F(MappedHashMapTest, mhmUnverifiedLookupsEndOnCorruptBuckets) {
+  using node_t = InlineMapNode<int64_t, Quote>;
+  save(lhm, path);
+
+  // mark every bucket occupied, leaving no empty bucket to stop a probe
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto capacity = (std::filesystem::file_size(path) -
+                     sizeof(snapshot_header)) /
+                    sizeof(node_t);
+    for (size_t i = 0; i < capacity; i++) {
+      file.seekp(sizeof(snapshot_header) + i * sizeof(node_t) +
+                 offsetof(node_t, is_occupied));
+      file.put(1);
+    }
+  }
+
+  mapped_hash_map<int64_t, Quote> mhm(path, snapshot_access::read_only, false);
+  EXPECT_TRUE(mhm.contains(7));
+  EXPECT_FALSE(mhm.contains(1));
+  EXPECT_EQ(mhm.find(1), mhm.end());
+}
+
+TEST_F(MappedHashMapTest, mhmRejectsForeignAndCorruptFiles) {
+  using snapshot_map = mapped_hash_map<int64_t, Quote>;
+  EXPECT_THROW(snapshot_map{path}, std::system_error);
+
+  save(lhm, path);
+  // different value type
+  EXPECT_THROW((mapped_hash_map<int64_t, int64_t>{path}), std::runtime_error);
+
+  // different hash function
+  struct shifted_hash {
+    size_t operator()(int64_t key) const { return key >> 1; }
+  };
+  EXPECT_THROW((mapped_hash_map<int64_t, Quote, shifted_hash>{path}),
+               std::runtime_error);
+
+  // flipped bucket byte, only caught when verifying
+  corrupt(sizeof(snapshot_header) + 3);
+  EXPECT_THROW(snapshot_map{path}, std::runtime_error);
+  EXPECT_NO_THROW((snapshot_map{path, snapshot_access::read_only, false}));
+
+  corrupt(0);
+  EXPECT_THROW((snapshot_map{path, snapshot_access::read_only, false}),
+               std::runtime_error);
+
+  std::filesystem::resize_file(path, sizeof(snapshot_header) - 1);
+  EXPECT_THROW(snapshot_map{path}, std::runtime_error);
+}
@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "../src/OpenAddressedHashMap.hxx"
@@ -114,4 +117,89 @@ TEST_F(OAHashMapTest, lhmReplacesDupKeyValue) {
 TEST_F(OAHashMapTest, lhmThrowsOnUnidentifiedKey) {
   EXPECT_THROW(lhm.at(100), std::out_of_range);
   EXPECT_THROW(lhm.at(15124), std::out_of_range);
-}
\ No newline at end of file
+}
+
+TEST_F(OAHashMapTest, lhmEraseClosesProbeChain) {
+  // 2 and 23 collide with 10 once the map has grown to 8 buckets
+  lhm.insert(MapNode(23, new int(23)));
+  EXPECT_EQ(lhm.erase(node2->key), 1);
+  EXPECT_EQ(lhm.erase(node2->key), 0);
+  EXPECT_FALSE(lhm.contains(node2->key));
+  EXPECT_TRUE(lhm.contains(node10->key));
+  EXPECT_TRUE(lhm.contains(23));
+  EXPECT_EQ(lhm.size(), 3);
+}
+
+TEST_F(OAHashMapTest, lhmBatchLookupsMatchFind) {
+  for (int i = 0; i < 100; i++)
+    lhm[i * 3] = i;
+
+  // more keys than one prefetched chunk, half of them misses
+  std::vector<int> keys;
+  for (int i = 0; i < 150; i++)
+    keys.push_back(i * 2);
+
+  std::vector<open_addressed_hash_map<int, int>::iterator> itrs(
+      keys.size(), lhm.end());
+  std::vector<const int *> values(keys.size());
+  auto found = std::make_unique<bool[]>(keys.size());
+
+  lhm.find_batch(keys, itrs);
+  std::as_const(lhm).find_batch(keys, values);
+  lhm.contains_batch(keys, {found.get(), keys.size()});
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_TRUE(itrs[i] == lhm.find(keys[i]));
+    EXPECT_EQ(found[i], lhm.contains(keys[i]));
+    if (found[i])
+      EXPECT_EQ(values[i], &lhm.at(keys[i]));
+    else
+      EXPECT_EQ(values[i], nullptr);
+  }
+}
+
+// identity hash like std::hash<uint64_t>, counting how many buckets erase
+// rehashes while closing holes
+struct counting_hash {
+  static inline size_t calls = 0;
+  size_t operator()(uint64_t key) const {
+    calls++;
+    return key;
+  }
+};
+
+TEST(OAHashMapEraseTest, lhmEraseOfSequentialKeysStaysLocal) {
+  constexpr uint64_t kKeys = 1 << 14;
+  open_addressed_hash_map<uint64_t, uint64_t, counting_hash> lhm;
+  for (uint64_t i = 0; i < kKeys; i++)
+    lhm[i] = i;
+
+  // masked identity hashes pack these keys into one cluster, which every
+  // backward shift would walk to its end
+  counting_hash::calls = 0;
+  for (uint64_t i = 0; i < kKeys; i++)
+    EXPECT_EQ(lhm.erase(i), 1);
+  EXPECT_TRUE(lhm.empty());
+  EXPECT_LT(counting_hash::calls, 16 * kKeys);
+}
+
+TEST(OAHashMapBatchTest, lhmBatchLookupOnEmptyMap) {
+  open_addressed_hash_map<int, int> empty;
+  std::vector<int> keys{1, 2, 3};
+  bool found[3] = {true, true, true};
+
+  empty.contains_batch(keys, found);
+  for (auto f : found)
+    EXPECT_FALSE(f);
+}
+
+TEST(OAHashMapStringKeyTest, lhmHashesKeyRatherThanValue) {
+  open_addressed_hash_map<std::string, int> shm;
+  for (int i = 0; i < 100; i++)
+    shm["key" + std::to_string(i)] = i;
+
+  EXPECT_EQ(shm.size(), 100);
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ(shm.at("key" + std::to_string(i)), i);
+  EXPECT_FALSE(shm.contains("key100"));
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+
+#include "../src/OpenAddressedHashMap.hxx"
+#include "../src/RobinHoodProbe.hxx"
+
+using namespace nhzaci;
+
+template <typename Index = mask_index, typename Hash = std::hash<int>>
+using robin_hood_map =
+    open_addressed_hash_map<int, int, Hash, std::equal_to<int>,
+                            std::allocator<MapNode<int, int>>,
+                            robin_hood_probe<int, MapNode<int, int>, Hash,
+                                             std::equal_to<int>, Index>>;
+
+class RobinHoodProbeTest : public ::testing::Test {
+protected:
+  robin_hood_map<> rhm;
+};
+
+TEST_F(RobinHoodProbeTest, rhmFindsAllInsertedKeysAcrossExpansions) {
+  for (int i = 0; i < 1000; i++)
+    rhm[i * 16] = i;
+
+  EXPECT_EQ(rhm.size(), 1000);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(rhm.at(i * 16), i);
+  EXPECT_FALSE(rhm.contains(1));
+}
+
+TEST_F(RobinHoodProbeTest, rhmEraseByKey) {
+  rhm[1] = 1;
+  rhm[2] = 2;
+  EXPECT_EQ(rhm.erase(1), 1);
+  EXPECT_EQ(rhm.erase(1), 0);
+  EXPECT_FALSE(rhm.contains(1));
+  EXPECT_EQ(rhm.at(2), 2);
+  EXPECT_EQ(rhm.size(), 1);
+}
+
+TEST_F(RobinHoodProbeTest, rhmEraseByIterator) {
+  rhm[5] = 50;
+  auto itr = rhm.find(5);
+  rhm.erase(itr);
+  EXPECT_FALSE(rhm.contains(5));
+  EXPECT_TRUE(rhm.empty());
+}
+
+TEST(RobinHoodProbeFibonacciTest, rhmMatchesUnorderedMapUnderChurn) {
+  robin_hood_map<fibonacci_index> rhm;
+  std::unordered_map<int, int> reference;
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<int> keys(0, 512);
+
+  for (int i = 0; i < 20000; i++) {
+    auto key = keys(gen);
+    if (gen() % 2) {
+      rhm[key] = i;
+      reference[key] = i;
+    } else {
+      EXPECT_EQ(rhm.erase(key), reference.erase(key));
+    }
+  }
+
+  EXPECT_EQ(rhm.size(), reference.size());
+  for (int key = 0; key <= 512; key++) {
+    EXPECT_EQ(rhm.contains(key), reference.contains(key));
+    if (reference.contains(key)) {
+      EXPECT_EQ(rhm.at(key), reference.at(key));
+    }
+  }
+}
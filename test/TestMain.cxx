@@ -1,6 +1,14 @@
 #include <gtest/gtest.h>
 
+#include "ConcurrentHashMapTest.cxx"
+#include "FrozenHashMapTest.cxx"
+#include "GroupProbeTest.cxx"
+#include "IncrementalRehashTest.cxx"
+#include "InlineHashMapTest.cxx"
+#include "MapStatsTest.cxx"
+#include "MappedHashMapTest.cxx"
 #include "OpenAddressedHashMapTest.cxx"
+#include "RobinHoodProbeTest.cxx"
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);